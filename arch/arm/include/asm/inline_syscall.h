@@ -0,0 +1,40 @@
+#ifndef ASM_INLINE_SYSCALL_H
+#define ASM_INLINE_SYSCALL_H
+
+/* Direct system call entry (EABI), bypassing glibc's variadic syscall()
+ * wrapper. Return values follow the kernel convention: -errno on failure.
+ *
+ * The system call number goes in r7, which is the frame pointer in Thumb
+ * mode (e.g., at -O0), so r7 cannot be bound as a register variable. As in
+ * glibc, it is saved in ip around the call instead.
+ */
+
+#define ARCH_HAS_INLINE_SYSCALL
+
+static inline long arch_syscall0(long nr)
+{
+	register long r0 __asm__("r0");
+	__asm__ __volatile__("mov ip, r7\n\t"
+			     "mov r7, %1\n\t"
+			     "svc #0\n\t"
+			     "mov r7, ip"
+			     : "=r" (r0)
+			     : "r" (nr)
+			     : "ip", "memory");
+	return r0;
+}
+
+static inline long arch_syscall1(long nr, long arg1)
+{
+	register long r0 __asm__("r0") = arg1;
+	__asm__ __volatile__("mov ip, r7\n\t"
+			     "mov r7, %1\n\t"
+			     "svc #0\n\t"
+			     "mov r7, ip"
+			     : "+r" (r0)
+			     : "r" (nr)
+			     : "ip", "memory");
+	return r0;
+}
+
+#endif
@@ -0,0 +1,7 @@
+#ifndef ASM_INLINE_SYSCALL_H
+#define ASM_INLINE_SYSCALL_H
+
+/* No inline system call stubs on sparc64 (yet); the generic code falls back
+ * to glibc's syscall(). */
+
+#endif
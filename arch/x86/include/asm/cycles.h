@@ -1,6 +1,8 @@
 #ifndef ASM_CYCLES_H
 #define ASM_CYCLES_H
 
+#include <cpuid.h>
+
 #define rdtscll(val) do { \
 	unsigned int __a,__d; \
 	__asm__ __volatile__("rdtsc" : "=a" (__a), "=d" (__d)); \
@@ -22,9 +24,78 @@ static __inline__ unsigned long long native_read_tsc(void)
 
 typedef unsigned long long cycles_t;
 
+/* TSC read variants, from the least to the most strictly ordered:
+ *
+ * get_cycles_unordered()  rdtsc: may be reordered with any neighboring
+ *                         instruction; only for long intervals.
+ * get_cycles_lfence()     lfence; rdtsc: waits until all earlier
+ *                         instructions have completed locally, later ones
+ *                         may start before the read (on AMD, only where the
+ *                         kernel made lfence dispatch-serializing).
+ * get_cycles_rdtscp()     rdtscp: waits until all earlier instructions have
+ *                         executed and earlier loads are globally visible
+ *                         (earlier stores may still be pending), later ones
+ *                         may start before the read. Also returns the
+ *                         TSC_AUX value, which Linux sets to the CPU number
+ *                         (low 12 bits) and NUMA node. Check
+ *                         tsc_has_rdtscp() before use.
+ * get_cycles()            mfence; rdtsc; mfence: earlier loads and stores
+ *                         are globally visible before the read, and later
+ *                         memory accesses wait for it. The most expensive.
+ */
+
+static inline cycles_t get_cycles_unordered(void)
+{
+	cycles_t val;
+
+	rdtscll(val);
+	return val;
+}
+
+static inline cycles_t get_cycles_lfence(void)
+{
+	cycles_t val;
+
+	__asm__ __volatile__("lfence":::"memory");
+	rdtscll(val);
+	return val;
+}
+
+static inline cycles_t get_cycles_rdtscp(unsigned int *aux)
+{
+	unsigned int a, d, c;
+
+	__asm__ __volatile__("rdtscp" : "=a" (a), "=d" (d), "=c" (c)
+			     :: "memory");
+	if (aux)
+		*aux = c;
+	return ((cycles_t) a) | (((cycles_t) d) << 32);
+}
+
 static inline cycles_t get_cycles(void)
 {
 	return native_read_tsc();
 }
 
+/* Whether the TSC runs at a constant rate in all P-, C-, and T-states
+ * (CPUID 0x80000007, EDX bit 8), i.e., can be used as a clock. */
+static inline int tsc_is_invariant(void)
+{
+	unsigned int a, b, c, d;
+
+	if (!__get_cpuid(0x80000007, &a, &b, &c, &d))
+		return 0;
+	return (d >> 8) & 1;
+}
+
+/* Whether rdtscp is supported (CPUID 0x80000001, EDX bit 27) */
+static inline int tsc_has_rdtscp(void)
+{
+	unsigned int a, b, c, d;
+
+	if (!__get_cpuid(0x80000001, &a, &b, &c, &d))
+		return 0;
+	return (d >> 27) & 1;
+}
+
 #endif
@@ -0,0 +1,62 @@
+#ifndef ASM_INLINE_SYSCALL_H
+#define ASM_INLINE_SYSCALL_H
+
+/* Direct system call entry, bypassing glibc's variadic syscall() wrapper.
+ * Return values follow the kernel convention: -errno on failure.
+ */
+
+#define ARCH_HAS_INLINE_SYSCALL
+
+#if defined(__x86_64__)
+
+static inline long arch_syscall0(long nr)
+{
+	long ret;
+	__asm__ __volatile__("syscall"
+			     : "=a" (ret)
+			     : "0" (nr)
+			     : "rcx", "r11", "memory");
+	return ret;
+}
+
+static inline long arch_syscall1(long nr, long arg1)
+{
+	long ret;
+	__asm__ __volatile__("syscall"
+			     : "=a" (ret)
+			     : "0" (nr), "D" (arg1)
+			     : "rcx", "r11", "memory");
+	return ret;
+}
+
+#elif defined(__i386__)
+
+static inline long arch_syscall0(long nr)
+{
+	long ret;
+	__asm__ __volatile__("int $0x80"
+			     : "=a" (ret)
+			     : "0" (nr)
+			     : "memory");
+	return ret;
+}
+
+/* %ebx may be reserved as the PIC register, so swap the argument in and out
+ * by hand instead of using the "b" constraint. */
+static inline long arch_syscall1(long nr, long arg1)
+{
+	long ret;
+	__asm__ __volatile__("xchgl %%ebx, %%edi\n\t"
+			     "int $0x80\n\t"
+			     "xchgl %%ebx, %%edi"
+			     : "=a" (ret)
+			     : "0" (nr), "D" (arg1)
+			     : "memory");
+	return ret;
+}
+
+#else
+#undef ARCH_HAS_INLINE_SYSCALL
+#endif
+
+#endif
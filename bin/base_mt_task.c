@@ -47,6 +47,12 @@ void* rt_thread(void *tcontext);
  */
 int job(void);
 
+/* litmus_run_periodic() continues while its job body returns nonzero */
+static int run_job(void *ctx, const struct litmus_job_info *info)
+{
+	return !job();
+}
+
 
 /* Catch errors.
  */
@@ -122,7 +128,6 @@ int main(int argc, char** argv)
  */
 void* rt_thread(void *tcontext)
 {
-	int do_exit;
 	struct thread_context *ctx = (struct thread_context *) tcontext;
 	struct rt_task param;
 
@@ -172,12 +177,13 @@ void* rt_thread(void *tcontext)
 	/*****
 	 * 3) Invoke real-time jobs.
 	 */
-	do {
-		/* Wait until the next job is released. */
-		sleep_next_period();
-		/* Invoke job. */
-		do_exit = job();		
-	} while (!do_exit);
+	/* Wait until the first job is released. */
+	sleep_next_period();
+	/* litmus_run_periodic() invokes job() once per period until it asks
+	 * to exit and completes each job with sleep_next_period();
+	 * struct litmus_periodic_opts can add a duration or job limit, hooks,
+	 * and deadline-miss detection. */
+	litmus_run_periodic(run_job, tcontext, NULL);
 
 
 	
@@ -48,6 +48,12 @@
  */
 int job(void);
 
+/* litmus_run_periodic() continues while its job body returns nonzero */
+static int run_job(void *ctx, const struct litmus_job_info *info)
+{
+	return !job();
+}
+
 /* typically, main() does a couple of things: 
  * 	1) parse command line parameters, etc.
  *	2) Setup work environment.
@@ -63,7 +69,6 @@ int job(void);
  */
 int main(int argc, char** argv)
 {
-	int do_exit;
 	struct rt_task param;
 
 	/* Setup task parameters */
@@ -130,12 +135,13 @@ int main(int argc, char** argv)
 	/*****
 	 * 5) Invoke real-time jobs.
 	 */
-	do {
-		/* Wait until the next job is released. */
-		sleep_next_period();
-		/* Invoke job. */
-		do_exit = job();		
-	} while (!do_exit);
+	/* Wait until the first job is released. */
+	sleep_next_period();
+	/* litmus_run_periodic() invokes job() once per period until it asks
+	 * to exit and completes each job with sleep_next_period();
+	 * struct litmus_periodic_opts can add a duration or job limit, hooks,
+	 * and deadline-miss detection. */
+	litmus_run_periodic(run_job, NULL, NULL);
 
 
 	
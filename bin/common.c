@@ -1,6 +1,12 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "common.h"
 
@@ -9,3 +15,391 @@ void bail_out(const char* msg)
 	perror(msg);
 	exit(-1 * errno);
 }
+
+/* how often spin_for() consults the clock */
+#define SPIN_CHECK_INTERVAL us2ns(250)
+
+/* calibration: median of SPIN_CALIB_TRIALS batches of roughly 1ms each */
+#define SPIN_CALIB_TRIALS 21
+#define SPIN_CALIB_BATCH  ms2ns(1)
+
+static volatile int spin_sink;
+
+static void spin_cache_file(struct spin_loop *sl, char *buf, size_t len)
+{
+	const char *dir = getenv("TMPDIR");
+	snprintf(buf, len, "%s/%s%s%s-loop.%d.calib",
+		 dir ? dir : "/tmp", sl->name,
+		 sl->params ? "-" : "", sl->params ? sl->params : "",
+		 (int) getuid());
+}
+
+/* The cache lives in a shared, world-writable directory: never follow
+ * symlinks, trust only regular files of our own (anyone can create a file
+ * under our name first), and replace it atomically so that concurrently
+ * calibrating processes never see a partial file. */
+static int spin_cache_read(const char *fname, double *ns_per_iter)
+{
+	struct stat st;
+	char buf[64];
+	ssize_t len;
+	int fd;
+
+	fd = open(fname, O_RDONLY | O_NOFOLLOW);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+	    st.st_uid != getuid()) {
+		close(fd);
+		return -1;
+	}
+	len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len <= 0)
+		return -1;
+	buf[len] = '\0';
+	return sscanf(buf, "%lf", ns_per_iter) == 1 ? 0 : -1;
+}
+
+static void spin_cache_write(const char *fname, double ns_per_iter)
+{
+	char tmp[PATH_MAX + 32], buf[64];
+	int fd, len;
+
+	snprintf(tmp, sizeof(tmp), "%s.%d.tmp", fname, (int) getpid());
+	fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0644);
+	if (fd < 0)
+		return;
+	len = snprintf(buf, sizeof(buf), "%.6f\n", ns_per_iter);
+	if (write(fd, buf, len) != len || close(fd) != 0 ||
+	    rename(tmp, fname) != 0)
+		unlink(tmp);
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double*) a, y = *(const double*) b;
+	return (x > y) - (x < y);
+}
+
+void spin_calibrate(struct spin_loop *sl, int force)
+{
+	double trials[SPIN_CALIB_TRIALS];
+	char fname[PATH_MAX];
+	lt_t start, end;
+	long iters, i;
+	int t, sink = 0;
+
+	spin_cache_file(sl, fname, sizeof(fname));
+	if (!force && spin_cache_read(fname, &sl->ns_per_iter) == 0 &&
+	    sl->ns_per_iter > 0)
+		return;
+
+	/* rough estimate to size the batches */
+	start = litmus_cputime();
+	for (i = 0; i < 10; i++)
+		sink += sl->work();
+	end = litmus_cputime();
+	iters = SPIN_CALIB_BATCH / ((end - start) / 10 + 1) + 1;
+
+	for (t = 0; t < SPIN_CALIB_TRIALS; t++) {
+		start = litmus_cputime();
+		for (i = 0; i < iters; i++)
+			sink += sl->work();
+		end = litmus_cputime();
+		trials[t] = (end - start) / (double) iters;
+	}
+	spin_sink = sink;
+
+	qsort(trials, SPIN_CALIB_TRIALS, sizeof(double), cmp_double);
+	sl->ns_per_iter = trials[SPIN_CALIB_TRIALS / 2];
+
+	spin_cache_write(fname, sl->ns_per_iter);
+}
+
+lt_t spin_for(struct spin_loop *sl, lt_t exec_ns, double emergency_exit)
+{
+	lt_t start, now, end;
+	long todo, per_check;
+	int sink = 0;
+	double err;
+
+	per_check = SPIN_CHECK_INTERVAL / sl->ns_per_iter + 1;
+
+	start = now = litmus_cputime();
+	end = start + exec_ns;
+	while (now < end) {
+		/* round to the nearest number of whole iterations */
+		todo = ((end - now) + sl->ns_per_iter / 2) / sl->ns_per_iter;
+		if (todo <= 0)
+			break;
+		if (todo > per_check)
+			todo = per_check;
+		while (todo--)
+			sink += sl->work();
+		now = litmus_cputime();
+
+		if (emergency_exit && wctime() > emergency_exit) {
+			/* Oops --- this should only be possible if the execution time tracking
+			 * is broken in the LITMUS^RT kernel. */
+			fprintf(stderr, "!!! %s/%d emergency exit!\n", sl->name, getpid());
+			fprintf(stderr, "Something is seriously wrong! Do not ignore this.\n");
+			break;
+		}
+	}
+	spin_sink = sink;
+
+	if (exec_ns) {
+		err = ((double) (now - start) - exec_ns) / exec_ns;
+		sl->spins++;
+		sl->sum_err += err;
+		if (err > sl->max_err || -err > sl->max_err)
+			sl->max_err = err > 0 ? err : -err;
+	}
+
+	return now - start;
+}
+
+void spin_report(struct spin_loop *sl)
+{
+	static const lt_t lengths[] = {
+		us2ns(10), us2ns(50), us2ns(100), us2ns(500),
+		ms2ns(1), ms2ns(5), ms2ns(10), ms2ns(50), ms2ns(100), ms2ns(500)
+	};
+	lt_t got;
+	int i;
+
+	printf("%s: %.2fns per iteration\n", sl->name, sl->ns_per_iter);
+	printf("%12s %14s %14s %9s\n",
+	       "requested", "achieved", "delta", "error");
+	for (i = 0; i < sizeof(lengths)/sizeof(lengths[0]); i++) {
+		got = spin_for(sl, lengths[i], 0);
+		printf("%10.3fms %12.6fms %12.6fms %8.4f%%\n",
+		       lengths[i] / 1e6, got / 1e6,
+		       ((double) got - lengths[i]) / 1e6,
+		       100 * ((double) got - lengths[i]) / lengths[i]);
+	}
+}
+
+void spin_print_stats(struct spin_loop *sl)
+{
+	if (sl->spins)
+		fprintf(stderr, "%s/%d: %lu spins, mean error %+.4f%%, "
+			"max |error| %.4f%%\n", sl->name, getpid(), sl->spins,
+			100 * sl->sum_err / sl->spins, 100 * sl->max_err);
+}
+
+static int is_separator(char c)
+{
+	return c == ' ' || c == '\t' || c == ',' || c == '\r';
+}
+
+/* Parse a decimal number of the form [-+]digits[.digits]. Anything else
+ * (exponents, more digits than fit into a double's mantissa) is handed to
+ * strtod(). Returns the end of the number, or NULL if there is none. */
+static const char* parse_double(const char *pos, const char *end, double *val)
+{
+	static const double pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+		1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18
+	};
+	const char *start = pos;
+	uint64_t mantissa = 0;
+	int digits = 0, frac = 0, neg = 0;
+	char buf[64];
+	size_t len;
+
+	if (pos < end && (*pos == '-' || *pos == '+'))
+		neg = *pos++ == '-';
+	for (; pos < end && *pos >= '0' && *pos <= '9'; pos++, digits++)
+		mantissa = mantissa * 10 + (*pos - '0');
+	if (pos < end && *pos == '.')
+		for (pos++; pos < end && *pos >= '0' && *pos <= '9';
+		     pos++, digits++, frac++)
+			mantissa = mantissa * 10 + (*pos - '0');
+
+	if (!digits)
+		return NULL;
+	if (digits <= 15 && (pos == end || (*pos != 'e' && *pos != 'E'))) {
+		/* exact: both operands are representable */
+		*val = mantissa / pow10[frac];
+		if (neg)
+			*val = -*val;
+		return pos;
+	}
+
+	/* slow path; the mapping is not NUL-terminated */
+	for (len = 0; start + len < end && len < sizeof(buf) - 1 &&
+		     !is_separator(start[len]) && start[len] != '\n'; len++)
+		buf[len] = start[len];
+	buf[len] = '\0';
+	*val = strtod(buf, NULL);
+	return start + len;
+}
+
+static void parse_exec_trace(struct exec_trace *trace, const char *file,
+			     int column, const char *pos, const char *end)
+{
+	const char *eol, *num;
+	unsigned long line = 0, size = 0;
+	double val;
+	int col;
+
+	for (; pos < end; pos = eol + 1) {
+		line++;
+		eol = memchr(pos, '\n', end - pos);
+		if (!eol)
+			eol = end;
+
+		while (pos < eol && is_separator(*pos))
+			pos++;
+		if (pos == eol || *pos == '#')
+			continue;
+
+		/* discard input until we get to the column we want */
+		for (col = 1; col < column; col++) {
+			while (pos < eol && !is_separator(*pos))
+				pos++;
+			while (pos < eol && is_separator(*pos))
+				pos++;
+		}
+
+		num = parse_double(pos, eol, &val);
+		if (!num || (num < eol && !is_separator(*num))) {
+			fprintf(stderr, "%s:%lu: invalid execution time\n",
+				file, line);
+			exit(EXIT_FAILURE);
+		}
+
+		if (trace->num_jobs == size) {
+			size = size ? size * 2 : 4096;
+			trace->parsed = realloc(trace->parsed,
+						size * sizeof(double));
+			if (!trace->parsed)
+				bail_out("couldn't allocate memory");
+		}
+		trace->parsed[trace->num_jobs++] = val;
+		trace->total += val;
+	}
+	trace->times = trace->parsed;
+}
+
+void load_exec_trace(struct exec_trace *trace, const char *file, int column)
+{
+	const struct exec_trace_header *hdr;
+	struct stat st;
+	int fd;
+
+	memset(trace, 0, sizeof(*trace));
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) != 0)
+		bail_out("could not open execution time file");
+	if (!st.st_size)
+		bail_out("empty execution time file");
+
+	trace->map_len = st.st_size;
+	trace->map = mmap(NULL, trace->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (trace->map == MAP_FAILED)
+		bail_out("could not map execution time file");
+
+	hdr = trace->map;
+	if (trace->map_len >= sizeof(*hdr) && hdr->magic == EXEC_TRACE_MAGIC) {
+		/* divide rather than multiply, so that a huge num_jobs
+		 * cannot overflow the check */
+		if (hdr->num_jobs >
+		    (trace->map_len - sizeof(*hdr)) / sizeof(double)) {
+			fprintf(stderr, "%s: truncated execution time file\n",
+				file);
+			exit(EXIT_FAILURE);
+		}
+		trace->times = (const double*) (hdr + 1);
+		trace->num_jobs = hdr->num_jobs;
+		trace->total = hdr->total;
+		/* replay reads each job once, front to back */
+		madvise(trace->map, trace->map_len, MADV_SEQUENTIAL);
+		return;
+	}
+
+	parse_exec_trace(trace, file, column, trace->map,
+			 (const char*) trace->map + trace->map_len);
+	/* the text is not needed anymore */
+	munmap(trace->map, trace->map_len);
+	trace->map = NULL;
+
+	if (!trace->num_jobs) {
+		fprintf(stderr, "%s: no execution times\n", file);
+		exit(EXIT_FAILURE);
+	}
+}
+
+int write_exec_trace(const struct exec_trace *trace, const char *file)
+{
+	struct exec_trace_header hdr = {
+		.magic = EXEC_TRACE_MAGIC,
+		.num_jobs = trace->num_jobs,
+		.total = trace->total,
+	};
+	FILE *out;
+	int ret = 0;
+
+	out = fopen(file, "wb");
+	if (!out)
+		return -1;
+	if (fwrite(&hdr, sizeof(hdr), 1, out) != 1 ||
+	    fwrite(trace->times, sizeof(double), trace->num_jobs, out)
+	    != trace->num_jobs)
+		ret = -1;
+	if (fclose(out))
+		ret = -1;
+	return ret;
+}
+
+void free_exec_trace(struct exec_trace *trace)
+{
+	if (trace->map)
+		munmap(trace->map, trace->map_len);
+	free(trace->parsed);
+	memset(trace, 0, sizeof(*trace));
+}
+
+int spin_job(void *ctx, const struct litmus_job_info *info)
+{
+	struct spin_job *sj = ctx;
+	double exec_time = sj->exec_time, program_end = sj->program_end;
+	double chunk1, chunk2;
+
+	if (sj->exec_times)
+		/* convert job's length to seconds */
+		exec_time = sj->exec_times[sj->cur_job++] * 0.001 * sj->scale;
+
+	if (sj->lock_od >= 0) {
+		/* simulate critical section somewhere in the middle */
+		chunk1 = drand48() * (exec_time - sj->cs_length);
+		chunk2 = exec_time - sj->cs_length - chunk1;
+
+		/* non-critical section */
+		sj->loop_for(chunk1, program_end + 1);
+
+		/* critical section */
+		litmus_lock(sj->lock_od);
+		sj->loop_for(sj->cs_length, program_end + 1);
+		litmus_unlock(sj->lock_od);
+
+		/* non-critical section */
+		sj->loop_for(chunk2, program_end + 2);
+	} else {
+		sj->loop_for(exec_time, program_end + 1);
+	}
+	return 1;
+}
+
+int spin_job_print(void *ctx, const struct litmus_job_info *info)
+{
+	struct spin_job *sj = ctx;
+
+	printf("%s/%d:%u @ %.4fms\n", sj->name, gettid(),
+	       info->job_no, (wctime() - sj->start) * 1000);
+	return 1;
+}
@@ -0,0 +1,49 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "common.h"
+
+/* Convert a text file of per-job execution times into the binary format
+ * that the spinning tools can map and replay without parsing. */
+
+#define OPTSTR "o:"
+
+static void usage(char *error)
+{
+	fprintf(stderr, "Error: %s\n", error);
+	fprintf(stderr,
+		"Usage: convert_exec_times [-o COLUMN] TEXT-FILE BINARY-FILE\n"
+		"\n"
+		"COLUMN selects the execution times in TEXT-FILE (default: 1).\n");
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	struct exec_trace trace;
+	int column = 1;
+	int opt;
+
+	while ((opt = getopt(argc, argv, OPTSTR)) != -1) {
+		switch (opt) {
+		case 'o':
+			column = atoi(optarg);
+			if (column <= 0)
+				usage("COLUMN must be positive.");
+			break;
+		default:
+			usage("Bad argument.");
+		}
+	}
+	if (argc - optind != 2)
+		usage("Arguments missing.");
+
+	load_exec_trace(&trace, argv[optind], column);
+	if (write_exec_trace(&trace, argv[optind + 1]) != 0)
+		bail_out("could not write binary execution time file");
+
+	printf("%lu jobs, %.3fms total\n", trace.num_jobs, trace.total);
+	free_exec_trace(&trace);
+	return 0;
+}
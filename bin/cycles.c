@@ -1,19 +1,52 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <pthread.h>
 
+#include "litmus.h"
 #include "asm/cycles.h"
 
-int main(int argc, char** argv)
+/* Without options, print the cycle counter rate over sleep()s of SECS
+ * seconds forever. -i reports the counter's properties, its calibration
+ * against CLOCK_MONOTONIC_RAW, and the cost of the read variants; -s
+ * measures the offsets of the counters of all pairs of CPUs. */
+
+#define OPTSTR "isn:"
+
+#if defined(__i386__) || defined(__x86_64__)
+#define HAVE_TSC
+#endif
+
+/* state shared by the two sides of an offset measurement, in a cache line
+ * of its own */
+struct skew_probe {
+	volatile unsigned int request;
+	volatile unsigned int ack;
+	volatile cycles_t remote;
+	int cpu;
+	int rounds;
+} __attribute__((aligned(64)));
+
+static void usage(char *error)
+{
+	fprintf(stderr, "Error: %s\n", error);
+	fprintf(stderr,
+		"Usage: cycles [SECS]\n"
+		"       cycles -i [SECS]\n"
+		"       cycles -s [-n ROUNDS]\n"
+		"\n"
+		"-i reports whether the counter is invariant, calibrates it\n"
+		"   over SECS seconds (default: 1), and measures the read\n"
+		"   variants. -s measures the counter offset between each pair\n"
+		"   of CPUs, keeping the round trip with the least delay out of\n"
+		"   ROUNDS (default: 1000).\n");
+	exit(EXIT_FAILURE);
+}
+
+static void print_rate(int secs)
 {
 	cycles_t t1, t2;
-	int secs = 1;
 
-	if (argc > 1) {
-		secs = atoi(argv[1]);
-		if (secs <= 0)
-			secs = 1;
-	}
 	while (1) {
 		t1 = get_cycles();
 		sleep(secs);
@@ -24,5 +57,168 @@ int main(int argc, char** argv)
 		       t2 / (secs * 1000.0),
 		       t2 / (secs * 1000000.0));
 	}
+}
+
+#define READ_CALLS 1000000
+
+/* average cost of one read, in cycles */
+#define READ_COST(read) ({					\
+	cycles_t __start, __sink = 0;				\
+	int __i;						\
+	__start = get_cycles();					\
+	for (__i = 0; __i < READ_CALLS; __i++)			\
+		__sink += read;					\
+	(void) __sink;						\
+	(get_cycles() - __start) / (double) READ_CALLS;		\
+})
+
+static void print_info(int secs)
+{
+	struct litmus_cycles_calib calib;
+
+#ifdef HAVE_TSC
+	printf("invariant TSC:  %s\n", tsc_is_invariant() ? "yes" : "no");
+	printf("rdtscp:         %s\n", tsc_has_rdtscp() ? "yes" : "no");
+#endif
+	if (litmus_calibrate_cycles(s2ns(secs)) != 0 ||
+	    litmus_cycles_calibration(&calib) != 0) {
+		fprintf(stderr, "calibration failed\n");
+		exit(EXIT_FAILURE);
+	}
+	printf("frequency:      %.0f Hz +/- %.3f ppm (over %.3fs of "
+	       "CLOCK_MONOTONIC_RAW)\n", calib.hz, calib.error_ppm,
+	       calib.duration / 1E9);
+	printf("ns per cycle:   %.6f\n", 1E9 / calib.hz);
+
+	printf("read cost in cycles:\n");
+	printf("  %-22s %8.1f\n", "get_cycles()", READ_COST(get_cycles()));
+#ifdef HAVE_TSC
+	printf("  %-22s %8.1f\n", "get_cycles_rdtscp()",
+	       tsc_has_rdtscp() ? READ_COST(get_cycles_rdtscp(NULL)) : 0.0);
+	printf("  %-22s %8.1f\n", "get_cycles_lfence()",
+	       READ_COST(get_cycles_lfence()));
+	printf("  %-22s %8.1f\n", "get_cycles_unordered()",
+	       READ_COST(get_cycles_unordered()));
+#endif
+}
+
+static void* skew_responder(void *arg)
+{
+	struct skew_probe *p = arg;
+	int r;
+
+	if (be_migrate_to_cpu(p->cpu) != 0) {
+		perror("be_migrate_to_cpu");
+		exit(EXIT_FAILURE);
+	}
+	for (r = 1; r <= p->rounds; r++) {
+		while (p->request != r)
+			/* spin */;
+		p->remote = get_cycles();
+		__sync_synchronize();
+		p->ack = r;
+	}
+	return NULL;
+}
+
+/* Offset of the counter of CPU `to` relative to CPU `from`: the remote
+ * reading minus the midpoint of the local round trip around it. The error
+ * is at most half of the shortest round trip. */
+static void measure_skew(int from, int to, int rounds,
+			 long long *offset, cycles_t *rtt)
+{
+	struct skew_probe *p;
+	pthread_t thread;
+	cycles_t t0, t1, best = ~0ULL;
+	int r;
+
+	if (posix_memalign((void**) &p, 64, sizeof(*p))) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	p->request = p->ack = 0;
+	p->cpu = to;
+	*offset = 0;
+	p->rounds = rounds;
+
+	if (be_migrate_to_cpu(from) != 0) {
+		perror("be_migrate_to_cpu");
+		exit(EXIT_FAILURE);
+	}
+	if (pthread_create(&thread, NULL, skew_responder, p)) {
+		fprintf(stderr, "could not create responder thread\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (r = 1; r <= rounds; r++) {
+		t0 = get_cycles();
+		p->request = r;
+		while (p->ack != r)
+			/* spin */;
+		t1 = get_cycles();
+		if (t1 - t0 < best) {
+			best = t1 - t0;
+			*offset = (long long) (p->remote - t0) -
+				(long long) (t1 - t0) / 2;
+		}
+	}
+	pthread_join(thread, NULL);
+	free(p);
+	*rtt = best;
+}
+
+static void print_skew(int rounds)
+{
+	int ncpus = num_online_cpus(), i, j;
+	long long offset;
+	cycles_t rtt;
+
+	if (ncpus < 2) {
+		fprintf(stderr, "need at least two online CPUs\n");
+		exit(EXIT_FAILURE);
+	}
+	printf("%4s %4s %12s %10s\n", "from", "to", "offset", "+/-");
+	for (i = 0; i < ncpus; i++)
+		for (j = i + 1; j < ncpus; j++) {
+			measure_skew(i, j, rounds, &offset, &rtt);
+			printf("%4d %4d %12lld %10" CYCLES_FMT "\n",
+			       i, j, offset, rtt / 2);
+		}
+	printf("(cycles, counter of 'to' minus counter of 'from')\n");
+}
+
+int main(int argc, char** argv)
+{
+	int secs = 1, info = 0, skew = 0, rounds = 1000, opt;
+
+	while ((opt = getopt(argc, argv, OPTSTR)) != -1) {
+		switch (opt) {
+		case 'i':
+			info = 1;
+			break;
+		case 's':
+			skew = 1;
+			break;
+		case 'n':
+			rounds = atoi(optarg);
+			if (rounds <= 0)
+				usage("ROUNDS must be positive.");
+			break;
+		default:
+			usage("Bad argument.");
+		}
+	}
+	if (optind < argc) {
+		secs = atoi(argv[optind]);
+		if (secs <= 0)
+			secs = 1;
+	}
+
+	if (info)
+		print_info(secs);
+	if (skew)
+		print_skew(rounds);
+	if (!info && !skew)
+		print_rate(secs);
 	return 0;
 }
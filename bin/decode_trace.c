@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "litmus.h"
+
+/* Turn a trace file written by litmus_trace_start() into per-event latency
+ * tables. Each table row covers the interval between a pair of events of
+ * the same thread, e.g., from requesting a lock until acquiring it. */
+
+#define OPTSTR "f:"
+
+struct pair {
+	const char *name;
+	int from;
+	int to;
+	/* whether both events must carry the same argument */
+	int match_arg;
+};
+
+static const struct pair pairs[] = {
+	{"job",               LITMUS_EV_JOB_START,
+	                      LITMUS_EV_JOB_END, 0},
+	{"sleep_next_period", LITMUS_EV_SLEEP_NEXT_PERIOD,
+	                      LITMUS_EV_SLEEP_NEXT_PERIOD_DONE, 0},
+	{"lock",              LITMUS_EV_LOCK_REQUEST,
+	                      LITMUS_EV_LOCK_ACQUIRED, 1},
+	{"lock held",         LITMUS_EV_LOCK_ACQUIRED,
+	                      LITMUS_EV_LOCK_RELEASE, 1},
+	{"unlock",            LITMUS_EV_LOCK_RELEASE,
+	                      LITMUS_EV_LOCK_RELEASED, 1},
+	{"np section",        LITMUS_EV_NP_ENTER,
+	                      LITMUS_EV_NP_EXIT, 0},
+};
+
+#define NUM_PAIRS (sizeof(pairs) / sizeof(pairs[0]))
+
+struct samples {
+	uint64_t *val;
+	size_t count;
+	size_t size;
+};
+
+/* last occurrence of each event per thread */
+struct thread_state {
+	uint32_t tid;
+	int seen[LITMUS_EV_MAX];
+	struct litmus_trace_rec last[LITMUS_EV_MAX];
+};
+
+static struct samples samples[NUM_PAIRS];
+static struct thread_state *threads;
+static int num_threads;
+
+static void usage(char *error)
+{
+	fprintf(stderr, "Error: %s\n", error);
+	fprintf(stderr,
+		"Usage: decode_trace [-f MHZ] TRACE-FILE\n"
+		"\n"
+		"Latencies are reported in cycles, or in microseconds if the\n"
+		"cycle counter frequency is given in MHz.\n");
+	exit(EXIT_FAILURE);
+}
+
+static void add_sample(struct samples *s, uint64_t val)
+{
+	if (s->count == s->size) {
+		s->size = s->size ? s->size * 2 : 1024;
+		s->val = realloc(s->val, s->size * sizeof(*s->val));
+		if (!s->val) {
+			fprintf(stderr, "out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	s->val[s->count++] = val;
+}
+
+static struct thread_state* get_thread(uint32_t tid)
+{
+	int i;
+
+	for (i = 0; i < num_threads; i++)
+		if (threads[i].tid == tid)
+			return &threads[i];
+
+	threads = realloc(threads, (num_threads + 1) * sizeof(*threads));
+	if (!threads) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	memset(&threads[num_threads], 0, sizeof(*threads));
+	threads[num_threads].tid = tid;
+	return &threads[num_threads++];
+}
+
+static void process(struct thread_state *t, struct litmus_trace_rec *rec)
+{
+	const struct litmus_trace_rec *from;
+	int i;
+
+	if (rec->event >= LITMUS_EV_MAX)
+		return;
+
+	for (i = 0; i < NUM_PAIRS; i++) {
+		if (pairs[i].to != rec->event || !t->seen[pairs[i].from])
+			continue;
+		from = &t->last[pairs[i].from];
+		if (pairs[i].match_arg && from->arg != rec->arg)
+			continue;
+		if (rec->timestamp >= from->timestamp)
+			add_sample(&samples[i], rec->timestamp - from->timestamp);
+	}
+	t->seen[rec->event] = 1;
+	t->last[rec->event] = *rec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+	return (x > y) - (x < y);
+}
+
+static void report(double mhz)
+{
+	struct samples *s;
+	double scale = mhz > 0 ? 1 / mhz : 1;
+	int i;
+
+	printf("%-18s %10s %12s %12s %12s %12s %12s\n",
+	       "event", "count", "min", "median", "p99", "p99.9", "max");
+	for (i = 0; i < NUM_PAIRS; i++) {
+		s = &samples[i];
+		if (!s->count)
+			continue;
+		qsort(s->val, s->count, sizeof(*s->val), cmp_u64);
+		printf("%-18s %10zu %12.2f %12.2f %12.2f %12.2f %12.2f\n",
+		       pairs[i].name, s->count,
+		       s->val[0] * scale,
+		       s->val[s->count / 2] * scale,
+		       s->val[(size_t) (s->count * 0.99)] * scale,
+		       s->val[(size_t) (s->count * 0.999)] * scale,
+		       s->val[s->count - 1] * scale);
+	}
+	printf("(%s)\n", mhz > 0 ? "microseconds" : "cycles");
+}
+
+int main(int argc, char **argv)
+{
+	struct litmus_trace_chunk chunk;
+	struct litmus_trace_rec *recs = NULL;
+	struct thread_state *t;
+	size_t recs_size = 0, i;
+	unsigned long events = 0, dropped = 0;
+	double mhz = 0;
+	FILE *f;
+	int opt;
+
+	while ((opt = getopt(argc, argv, OPTSTR)) != -1) {
+		switch (opt) {
+		case 'f':
+			mhz = atof(optarg);
+			if (mhz <= 0)
+				usage("MHZ must be positive.");
+			break;
+		default:
+			usage("Bad argument.");
+		}
+	}
+	if (optind != argc - 1)
+		usage("TRACE-FILE missing.");
+
+	f = fopen(argv[optind], "rb");
+	if (!f) {
+		perror(argv[optind]);
+		return EXIT_FAILURE;
+	}
+
+	while (fread(&chunk, sizeof(chunk), 1, f) == 1) {
+		if (chunk.magic != LITMUS_TRACE_MAGIC) {
+			fprintf(stderr, "%s: corrupt trace file\n",
+				argv[optind]);
+			return EXIT_FAILURE;
+		}
+		if (chunk.count > recs_size) {
+			recs_size = chunk.count;
+			recs = realloc(recs, recs_size * sizeof(*recs));
+			if (!recs) {
+				fprintf(stderr, "out of memory\n");
+				return EXIT_FAILURE;
+			}
+		}
+		if (fread(recs, sizeof(*recs), chunk.count, f) != chunk.count) {
+			fprintf(stderr, "%s: truncated trace file\n",
+				argv[optind]);
+			break;
+		}
+
+		t = get_thread(chunk.tid);
+		for (i = 0; i < chunk.count; i++) {
+			if (recs[i].event == LITMUS_EV_DROPPED) {
+				/* don't pair across the gap */
+				memset(t->seen, 0, sizeof(t->seen));
+				dropped += recs[i].arg;
+			} else {
+				process(t, &recs[i]);
+				events++;
+			}
+		}
+		if (chunk.dropped)
+			/* events are missing, don't pair across the gap */
+			memset(t->seen, 0, sizeof(t->seen));
+
+		dropped += chunk.dropped;
+	}
+	fclose(f);
+
+	printf("%lu events from %d threads, %lu dropped\n",
+	       events, num_threads, dropped);
+	report(mhz);
+	return 0;
+}
@@ -14,117 +14,18 @@
 #include "common.h"
 
 #define PAGE_SIZE (4096)
+/* before cache_common.h, which otherwise uses the CPU's line size */
 #define CACHELINE_SIZE 32
-#define INTS_IN_CACHELINE (CACHELINE_SIZE/sizeof(int))
+#include "cache_common.h"
+
 #define CACHELINES_IN_1KB (1024 / sizeof(cacheline_t))
 #define INTS_IN_1KB	(1024 / sizeof(int))
-#define INTS_IN_CACHELINE (CACHELINE_SIZE/sizeof(int))
-
-typedef struct cacheline
-{
-        int line[INTS_IN_CACHELINE];
-} __attribute__((aligned(CACHELINE_SIZE))) cacheline_t;
 
 static int loops = 10;
 static cacheline_t* arena = NULL;
 
 struct timeval t1,t2;
 
-inline unsigned long get_cyclecount (void)
-{
-	unsigned long value;
-	// Read CCNT Register
-	asm volatile ("MRC p15, 0, %0, c9, c13, 0\t\n": "=r"(value));
-	return value;
-}
-
-#if 1
-#define UNCACHE_DEV "/dev/litmus/uncache"
-
-static cacheline_t* alloc_arena(size_t size, int use_huge_pages, int use_uncache_pages)
-{
-    int flags = MAP_PRIVATE | MAP_POPULATE;
-    cacheline_t* arena = NULL;
-    int fd;
-
-    if(use_huge_pages)
-        flags |= MAP_HUGETLB;
-
-	if(use_uncache_pages) {
-			fd = open(UNCACHE_DEV, O_RDWR|O_SYNC);
-			if (fd == -1)
-					bail_out("Failed to open uncache device. Are you running the LITMUS^RT kernel?");
-	}
-	else {
-			fd = -1;
-			flags |= MAP_ANONYMOUS;
-	}
-
-    arena = mmap(0, size, PROT_READ | PROT_WRITE, flags, fd, 0);
-	
-    if(use_uncache_pages)
-		close(fd);
-
-    assert(arena);
-
-        return arena;
-}
-#else
-static cacheline_t* alloc_arena(size_t size)
-{
-    int flags = MAP_PRIVATE | MAP_POPULATE | MAP_ANONYMOUS;
-    cacheline_t* arena = NULL;
-    
-    arena = mmap(0, size, PROT_READ | PROT_WRITE, flags, -1, 0);
-	
-    assert(arena);
-    return arena;
-}
-#endif
-
-static void dealloc_arena(cacheline_t* arena, size_t size)
-{
-		int ret = munmap((void*)arena, size);
-        if(ret != 0)
-                bail_out("munmap() error");
-}
-
-static int randrange(int min, int max)
-{
-        /* generate a random number on the range [min, max) w/o skew */
-        int limit = max - min;
-        int devisor = RAND_MAX/limit;
-        int retval;
-
-        do {
-                retval = rand() / devisor;
-        } while(retval == limit);
-        retval += min;
-
-        return retval;
-}
-
-static void init_arena(cacheline_t* arena, size_t size)
-{
-    int i;
-        size_t num_arena_elem = size / sizeof(cacheline_t);
-
-        /* Generate a cycle among the cache lines using Sattolo's algorithm.
-           Every int in the cache line points to the same cache line.
-           Note: Sequential walk doesn't care about these values. */
-        for (i = 0; i < num_arena_elem; i++) {
-                int j;
-                for(j = 0; j < INTS_IN_CACHELINE; ++j)
-                        arena[i].line[j] = i;
-        }
-        while(1 < i--) {
-                int j = randrange(0, i);
-                cacheline_t temp = arena[j];
-                arena[j] = arena[i];
-                arena[i] = temp;
-        }
-}
-
 /* Random walk around the arena in cacheline-sized chunks.
    Cacheline-sized chucks ensures the same utilization of each
    hit line as sequential read. (Otherwise, our utilization
@@ -183,9 +84,12 @@ static void usage(char *error) {
 		"\n"
 		"COMMON-OPTS = [-w] [-s SCALE]\n"
 		"              [-p PARTITION/CLUSTER [-z CLUSTER SIZE]] [-m CRITICALITY LEVEL]\n"
-		"              [-k WSS] [-l LOOPS] [-b BUDGET]\n"
+		"              [-k WSS] [-l LOOPS] [-b BUDGET] [-A ARENA-FILE]\n"
 		"\n"
-		"WCET and PERIOD are milliseconds, DURATION is seconds.\n");
+		"WCET and PERIOD are milliseconds, DURATION is seconds.\n"
+		"-A maps the arena from ARENA-FILE (e.g., on hugetlbfs), which is\n"
+		"   created on first use. It can be reused by any tool built with\n"
+		"   the same cache line size for the same working set size.\n");
 	exit(EXIT_FAILURE);
 }
 
@@ -204,28 +108,18 @@ static int loop_once(int wss)
 	return dont_optimize_me;
 }
 
-static int job(int wss, double exec_time, double program_end)
+static int job(void *ctx, const struct litmus_job_info *info)
 {
-	if (wctime() > program_end)
-		return 0;
-	else {
-		//register unsigned long t;
-		register unsigned int iter = 0;
-		//t = get_cyclecount();
-		//gettimeofday(&t1, NULL);
-		while(iter++ < loops) {
-			loop_once(wss);
-		}
-		//gettimeofday(&t2, NULL);
-		//t = get_cyclecount() - t;
-		//printf("%ld cycles\n", t);
-		//printf("%ld us\n", ((t2.tv_sec * 1000000 + t2.tv_usec) - (t1.tv_sec * 1000000 + t1.tv_usec)));
-   		sleep_next_period(); 
-    	return 1;
+	int wss = *(int*) ctx;
+	unsigned int iter = 0;
+
+	while(iter++ < loops) {
+		loop_once(wss);
 	}
+	return 1;
 }
 
-#define OPTSTR "p:wl:m:i:b:k:"
+#define OPTSTR "p:wl:m:i:b:k:A:"
 int main(int argc, char** argv)
 {
 	int ret, i;
@@ -235,14 +129,16 @@ int main(int argc, char** argv)
 	int migrate = 0;
 	int cluster = 0;
 	int opt;
+	const char *arena_file = NULL;
 	int wait = 0;
-	double duration = 0, start = 0;
+	double duration = 0;
 	struct rt_task param;
 	struct mc2_task mc2_param;
 	struct reservation_config config;
 	int res_type = PERIODIC_POLLING;
 	size_t arena_sz;
 	int wss;
+	struct litmus_periodic_opts opts = {0};
 
 	/* default for reservation */
 	config.id = 0;
@@ -283,6 +179,9 @@ int main(int argc, char** argv)
 		case 'i':
 			config.priority = atoi(optarg);
 			break;
+		case 'A':
+			arena_file = optarg;
+			break;
 		case ':':
 			usage("Argument missing.");
 			break;
@@ -361,14 +260,18 @@ int main(int argc, char** argv)
 		bail_out("could not setup mc2 task params");
 	
 	arena_sz = wss*1024;
-	arena = alloc_arena(arena_sz, 0, 0);
-	init_arena(arena, arena_sz);
+	if (arena_file)
+		/* built once, shared with other users of the file */
+		arena = map_shared_arena(arena_file, arena_sz);
+	else {
+		arena = alloc_arena(arena_sz, 0, 0);
+		init_arena(arena, arena_sz);
+	}
 	
 	ret = init_litmus();
 	if (ret != 0)
 		bail_out("init_litmus() failed\n");
 
-	start = wctime();
 	ret = task_mode(LITMUS_RT_TASK);
 	if (ret != 0)
 		bail_out("could not become RT task");
@@ -384,10 +287,11 @@ int main(int argc, char** argv)
 		ret = wait_for_ts_release();
 		if (ret != 0)
 			bail_out("wait_for_ts_release()");
-		start = wctime();
 	}
 
-	while (job(wss, wcet_ms * 0.001, start + duration)) {};
+	opts.duration = s2ns(duration);
+	if (litmus_run_periodic(job, &wss, &opts) < 0)
+		bail_out("sleep_next_period()");
 
 	ret = task_mode(BACKGROUND_TASK);
 	if (ret != 0)
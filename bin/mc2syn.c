@@ -6,7 +6,6 @@
 #include <unistd.h>
 #include <time.h>
 #include <string.h>
-#include <assert.h>
 #include <limits.h>
 
 
@@ -64,74 +63,6 @@ static void usage(char *error) {
 	exit(EXIT_FAILURE);
 }
 
-/*
- * returns the character that made processing stop, newline or EOF
- */
-static int skip_to_next_line(FILE *fstream)
-{
-	int ch;
-	for (ch = fgetc(fstream); ch != EOF && ch != '\n'; ch = fgetc(fstream));
-	return ch;
-}
-
-static void skip_comments(FILE *fstream)
-{
-	int ch;
-	for (ch = fgetc(fstream); ch == '#'; ch = fgetc(fstream))
-		skip_to_next_line(fstream);
-	ungetc(ch, fstream);
-}
-
-static void get_exec_times(const char *file, const int column,
-			   int *num_jobs,    double **exec_times)
-{
-	FILE *fstream;
-	int  cur_job, cur_col, ch;
-	*num_jobs = 0;
-
-	fstream = fopen(file, "r");
-	if (!fstream)
-		bail_out("could not open execution time file");
-
-	/* figure out the number of jobs */
-	do {
-		skip_comments(fstream);
-		ch = skip_to_next_line(fstream);
-		if (ch != EOF)
-			++(*num_jobs);
-	} while (ch != EOF);
-
-	if (-1 == fseek(fstream, 0L, SEEK_SET))
-		bail_out("rewinding file failed");
-
-	/* allocate space for exec times */
-	*exec_times = calloc(*num_jobs, sizeof(*exec_times));
-	if (!*exec_times)
-		bail_out("couldn't allocate memory");
-
-	for (cur_job = 0; cur_job < *num_jobs && !feof(fstream); ++cur_job) {
-
-		skip_comments(fstream);
-
-		for (cur_col = 1; cur_col < column; ++cur_col) {
-			/* discard input until we get to the column we want */
-			int unused __attribute__ ((unused)) = fscanf(fstream, "%*s,");
-		}
-
-		/* get the desired exec. time */
-		if (1 != fscanf(fstream, "%lf", (*exec_times)+cur_job)) {
-			fprintf(stderr, "invalid execution time near line %d\n",
-					cur_job);
-			exit(EXIT_FAILURE);
-		}
-
-		skip_to_next_line(fstream);
-	}
-
-	assert(cur_job == *num_jobs);
-	fclose(fstream);
-}
-
 #define NUMS 4096
 static int num[NUMS];
 static char* progname;
@@ -156,21 +87,14 @@ static int loop_once(void)
 	return tmp;
 }
 
-static int loop_for(double exec_time, double emergency_exit)
+static void loop_for(double exec_time, double emergency_exit)
 {
-	double last_loop = 0, loop_start;
-	int tmp = 0;
 	int iter = 0;
 
-	double start = cputime();
-	double now = cputime();
-
-	//while (now + last_loop < start + exec_time) {
-	while(iter++ < loops) {
-		loop_start = now;
-		tmp = loop_once();
-		now = cputime();
-		last_loop = now - loop_start;
+	/* Fixed amount of work per job (see -l); exec_time is not used.
+	 * Only the wall clock is consulted, for the emergency exit. */
+	while (iter++ < loops) {
+		loop_once();
 		if (emergency_exit && wctime() > emergency_exit) {
 			/* Oops --- this should only be possible if the execution time tracking
 			 * is broken in the LITMUS^RT kernel. */
@@ -179,8 +103,6 @@ static int loop_for(double exec_time, double emergency_exit)
 			break;
 		}
 	}
-
-	return tmp;
 }
 
 
@@ -202,36 +124,6 @@ static void debug_delay_loop(void)
 	}
 }
 
-static int job(double exec_time, double program_end, int lock_od, double cs_length)
-{
-	double chunk1, chunk2;
-
-	if (wctime() > program_end)
-		return 0;
-	else {
-		if (lock_od >= 0) {
-			/* simulate critical section somewhere in the middle */
-			chunk1 = drand48() * (exec_time - cs_length);
-			chunk2 = exec_time - cs_length - chunk1;
-
-			/* non-critical section */
-			loop_for(chunk1, program_end + 1);
-
-			/* critical section */
-			litmus_lock(lock_od);
-			loop_for(cs_length, program_end + 1);
-			litmus_unlock(lock_od);
-
-			/* non-critical section */
-			loop_for(chunk2, program_end + 2);
-		} else {
-			loop_for(exec_time, program_end + 1);
-		}
-		sleep_next_period();
-		return 1;
-	}
-}
-
 struct lt_interval* parse_td_intervals(int num, char* optarg, unsigned int *num_intervals)
 {
 	int i, matched;
@@ -305,10 +197,9 @@ int main(int argc, char** argv)
 	const char *file = NULL;
 	int want_enforcement = 0;
 	double duration = 0, start = 0;
-	double *exec_times = NULL;
+	struct exec_trace trace = {0};
 	double scale = 1.0;
 	task_class_t class = RT_CLASS_HARD;
-	int cur_job = 0, num_jobs = 0;
 	struct rt_task param;
 	struct mc2_task mc2_param;
 	struct reservation_config config;
@@ -316,7 +207,8 @@ int main(int argc, char** argv)
 	int n_str, num_int = 0;
 
 	int verbose = 0;
-	unsigned int job_no;
+	struct spin_job sj = {0};
+	struct litmus_periodic_opts opts = {0};
 
 	/* locking */
 	int lock_od = -1;
@@ -425,15 +317,13 @@ int main(int argc, char** argv)
 	srand(getpid());
 
 	if (file) {
-		get_exec_times(file, column, &num_jobs, &exec_times);
+		load_exec_trace(&trace, file, column);
 
 		if (argc - optind < 2)
 			usage("Arguments missing.");
 
-		for (cur_job = 0; cur_job < num_jobs; ++cur_job) {
-			/* convert the execution time to seconds */
-			duration += exec_times[cur_job] * 0.001;
-		}
+		/* convert the execution time to seconds */
+		duration += trace.total * 0.001;
 	} else {
 		/*
 		 * if we're not reading from the CSV file, then we need
@@ -462,8 +352,8 @@ int main(int argc, char** argv)
 
 	if (!file)
 		duration  = atof(argv[optind + 2]);
-	else if (file && num_jobs > 1)
-		duration += period_ms * 0.001 * (num_jobs - 1);
+	else if (file && trace.num_jobs > 1)
+		duration += period_ms * 0.001 * (trace.num_jobs - 1);
 
 	if (migrate) {
 		ret = be_migrate_to_domain(cluster);
@@ -544,29 +434,31 @@ int main(int argc, char** argv)
 		start = wctime();
 	}
 
-	if (file) {
-		for (cur_job = 0; cur_job < num_jobs; ++cur_job) {
-			job(exec_times[cur_job] * 0.001 * scale,
-			    start + duration,
-			    lock_od, cs_length * 0.001);
-		}
-	} else {
-		do {
-			if (verbose) {
-				get_job_no(&job_no);
-				printf("rtspin/%d:%u @ %.4fms\n", gettid(),
-					job_no, (wctime() - start) * 1000);
-			}
-		} while (job(wcet_ms * 0.001 * scale, start + duration,
-			   lock_od, cs_length * 0.001));
-	}
+	sj.loop_for = loop_for;
+	sj.name = "mc2syn";
+	sj.exec_times = trace.times;
+	sj.exec_time = wcet_ms * 0.001 * scale;
+	sj.scale = scale;
+	sj.start = start;
+	sj.program_end = start + duration;
+	sj.lock_od = lock_od;
+	sj.cs_length = cs_length * 0.001;
+
+	opts.duration = s2ns(duration);
+	if (file)
+		opts.max_jobs = trace.num_jobs;
+	if (verbose)
+		opts.pre_job = spin_job_print;
+
+	if (litmus_run_periodic(spin_job, &sj, &opts) < 0)
+		bail_out("sleep_next_period()");
 
 	ret = task_mode(BACKGROUND_TASK);
 	if (ret != 0)
 		bail_out("could not become regular task (huh?)");
 
 	if (file)
-		free(exec_times);
+		free_exec_trace(&trace);
 
 	reservation_destroy(gettid(), config.cpu);
 	free(pages);
@@ -74,9 +74,12 @@ static void usage(char *error) {
 		"\n"
 		"COMMON-OPTS = [-w] [-s SCALE]\n"
 		"              [-p PARTITION/CLUSTER [-z CLUSTER SIZE]] [-m CRITICALITY LEVEL]\n"
-		"              [-k WSS] [-l LOOPS] [-b BUDGET]\n"
+		"              [-k WSS] [-l LOOPS] [-b BUDGET] [-A ARENA-FILE]\n"
 		"\n"
-		"WCET and PERIOD are milliseconds, DURATION is seconds.\n");
+		"WCET and PERIOD are milliseconds, DURATION is seconds.\n"
+		"-A maps the arena from ARENA-FILE (e.g., on hugetlbfs), which is\n"
+		"   created on first use. It can be reused by any tool built with\n"
+		"   the same cache line size for the same working set size.\n");
 	exit(EXIT_FAILURE);
 }
 
@@ -95,37 +98,36 @@ static int loop_once(void)
 	return dont_optimize_me;
 }
 
-static int job(double exec_time, double program_end)
+static int job(void *ctx, const struct litmus_job_info *info)
 {
-	if (wctime() > program_end)
-		return 0;
-	else {
-		double last_loop = 0, loop_start;
-		double start = cputime();
-		double now = cputime();
-		while(now + last_loop < start + exec_time) {
-			loop_start = now;
-			loop_once();
-			now = cputime();
-			last_loop = now - loop_start;
-		}
-		sleep_next_period(); 
-   		return 1;
+	double exec_time = *(double*) ctx;
+	double last_loop = 0, loop_start;
+	double start = cputime();
+	double now = cputime();
+
+	while(now + last_loop < start + exec_time) {
+		loop_start = now;
+		loop_once();
+		now = cputime();
+		last_loop = now - loop_start;
 	}
+	return 1;
 }
 
-#define OPTSTR "p:wm:i:k:"
+#define OPTSTR "p:wm:i:k:A:"
 int main(int argc, char** argv)
 {
 	int ret, i;
 	lt_t wcet, period, budget;
-	double wcet_ms, period_ms;
+	double wcet_ms, period_ms, exec_time;
+	struct litmus_periodic_opts opts = {0};
 	unsigned int priority = LITMUS_NO_PRIORITY;
 	int migrate = 0;
 	int cluster = 0;
 	int opt;
+	const char *arena_file = NULL;
 	int wait = 0;
-	double duration = 0, start = 0;
+	double duration = 0;
 	struct rt_task param;
 	struct mc2_task mc2_param;
 	struct reservation_config config;
@@ -159,6 +161,9 @@ int main(int argc, char** argv)
 		case 'i':
 			config.priority = atoi(optarg);
 			break;
+		case 'A':
+			arena_file = optarg;
+			break;
 		case ':':
 			usage("Argument missing.");
 			break;
@@ -234,14 +239,18 @@ int main(int argc, char** argv)
 		bail_out("could not setup mc2 task params");
 	
 	arena_sz = WSS*1024;
-	arena = alloc_arena(arena_sz, 0, 0);
-	init_arena(arena, arena_sz);
+	if (arena_file)
+		/* built once, shared with other users of the file */
+		arena = map_shared_arena(arena_file, arena_sz);
+	else {
+		arena = alloc_arena(arena_sz, 0, 0);
+		init_arena(arena, arena_sz);
+	}
 	
 	ret = init_litmus();
 	if (ret != 0)
 		bail_out("init_litmus() failed\n");
 
-	start = wctime();
 	ret = task_mode(LITMUS_RT_TASK);
 	if (ret != 0)
 		bail_out("could not become RT task");
@@ -257,10 +266,12 @@ int main(int argc, char** argv)
 		ret = wait_for_ts_release();
 		if (ret != 0)
 			bail_out("wait_for_ts_release()");
-		start = wctime();
 	}
 
-	while (job(wcet_ms * 0.001, start + duration)) {};
+	exec_time = wcet_ms * 0.001;
+	opts.duration = s2ns(duration);
+	if (litmus_run_periodic(job, &exec_time, &opts) < 0)
+		bail_out("sleep_next_period()");
 
 	ret = task_mode(BACKGROUND_TASK);
 	if (ret != 0)
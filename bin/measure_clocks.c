@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "litmus.h"
+
+/* Per-call cost and observed resolution of the clock sources that spin loops
+ * and benchmarks can poll. */
+
+#define DEFAULT_CALLS 1000000
+
+static volatile double sink_d;
+static volatile lt_t sink_lt;
+
+static void read_wctime(void)    { sink_d  = wctime(); }
+static void read_cputime(void)   { sink_d  = cputime(); }
+static void read_monotonic(void) { sink_lt = litmus_clock(); }
+static void read_thread_ns(void) { sink_lt = litmus_cputime(); }
+static void read_cycles(void)    { sink_lt = cycles_clock(); }
+static void read_raw_cycles(void){ sink_lt = get_cycles(); }
+
+/* cputime() in ns, to measure the resolution of the double itself */
+static lt_t cputime_ns(void)     { return (lt_t) (cputime() * 1E9); }
+
+static struct {
+	const char *name;
+	void (*read)(void);
+	lt_t (*now)(void); /* for resolution measurement, NULL: n/a */
+} sources[] = {
+	{"wctime()",        read_wctime,     NULL},
+	{"cputime()",       read_cputime,    cputime_ns},
+	{"litmus_clock()",  read_monotonic,  litmus_clock},
+	{"litmus_cputime()",read_thread_ns,  litmus_cputime},
+	{"cycles_clock()",  read_cycles,     cycles_clock},
+	{"get_cycles()",    read_raw_cycles, NULL},
+};
+
+#define NUM_SOURCES (sizeof(sources)/sizeof(sources[0]))
+
+/* smallest non-zero difference between consecutive readings */
+static lt_t resolution(lt_t (*now)(void))
+{
+	lt_t prev = now(), cur, best = ~0ULL;
+	int i;
+
+	for (i = 0; i < 10000; i++) {
+		cur = now();
+		if (cur > prev && cur - prev < best)
+			best = cur - prev;
+		prev = cur;
+	}
+	return best;
+}
+
+int main(int argc, char **argv)
+{
+	int calls = DEFAULT_CALLS, i, s;
+	lt_t start, end;
+
+	if (argc > 1) {
+		calls = atoi(argv[1]);
+		if (calls <= 0) {
+			fprintf(stderr, "Usage: %s [CALLS]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (litmus_calibrate_cycles(0) != 0)
+		fprintf(stderr, "Cycle counter calibration failed.\n");
+
+	printf("%-18s %12s %14s\n", "source", "ns/call", "resolution(ns)");
+	for (s = 0; s < NUM_SOURCES; s++) {
+		/* warm up */
+		for (i = 0; i < 1000; i++)
+			sources[s].read();
+
+		start = litmus_clock();
+		for (i = 0; i < calls; i++)
+			sources[s].read();
+		end = litmus_clock();
+
+		printf("%-18s %12.2f ", sources[s].name,
+		       (end - start) / (double) calls);
+		if (sources[s].now)
+			printf("%14llu\n", resolution(sources[s].now));
+		else
+			printf("%14s\n", "-");
+	}
+	return 0;
+}
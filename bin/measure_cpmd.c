@@ -0,0 +1,366 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <semaphore.h>
+#include <pthread.h>
+
+#include "litmus.h"
+#include "cache_common.h"
+
+/* Cache-related preemption and migration delay (CPMD): a job walks its
+ * working set once to warm the cache, walks it again (the warm pass), is
+ * then preempted or migrated, and walks it a third time (the cold pass). The
+ * difference between the cold and the warm pass is the delay caused by
+ * refilling the cache. Optionally, an aggressor walks its own buffer on the
+ * CPU where the job resumes while the job is suspended.
+ *
+ * Topology levels:
+ *   preempt      resume on the same CPU after the aggressor ran there;
+ *                reported as "suspend" without -a, where nothing else runs
+ *                on the CPU and the job only suspends itself
+ *   same-llc     migrate to a CPU that shares the last-level cache
+ *   cross-llc    migrate to a CPU that does not
+ * CPUs sharing the last-level cache are read from sysfs. */
+
+#define OPTSTR "c:w:n:d:a:"
+
+#define MAX_WSS 32
+
+enum level {
+	LEVEL_PREEMPT,
+	LEVEL_SAME_LLC,
+	LEVEL_CROSS_LLC,
+	NUM_LEVELS
+};
+
+static const char* level_name[NUM_LEVELS] = {
+	"preempt",
+	"same-llc",
+	"cross-llc",
+};
+
+struct aggressor {
+	pthread_t thread;
+	int cpu;
+	sem_t go;
+	cacheline_t *buf;
+	int num_lines;
+};
+
+static int samples = 1000;
+static int delay_us = 1000;
+static int aggressor_kb = 0;
+static struct aggressor aggressors[NUM_LEVELS];
+
+static void usage(char *error)
+{
+	fprintf(stderr, "Error: %s\n", error);
+	fprintf(stderr,
+		"Usage: measure_cpmd [-c CPU] [-w WSS[,WSS...]] [-n SAMPLES] "
+		"[-d DELAY] [-a AGGRESSOR-WSS]\n"
+		"\n"
+		"Working set sizes are in KB (default: 4,16,64,256,1024,4096,"
+		"16384).\n"
+		"DELAY is the suspension in microseconds (default: 1000).\n"
+		"With -a, an aggressor walks a buffer of the given size in KB\n"
+		"on the CPU where the job resumes while the job is suspended;\n"
+		"without it, resuming on the same CPU is reported as suspend.\n"
+		"Jobs start on CPU (default: 0).\n");
+	exit(EXIT_FAILURE);
+}
+
+static const char* level_label(enum level level)
+{
+	/* without an aggressor, nothing preempts the job on its own CPU */
+	if (level == LEVEL_PREEMPT && !aggressor_kb)
+		return "suspend";
+	return level_name[level];
+}
+
+static int cmp_delay(const void *a, const void *b)
+{
+	long long x = *(const long long*) a, y = *(const long long*) b;
+	return (x > y) - (x < y);
+}
+
+/* Follow the cycle set up by init_arena() through all lines of the working
+ * set. Each load depends on the previous one, so every miss is exposed. */
+static int chase(cacheline_t *arena, int num_lines)
+{
+	int next = 0, i;
+
+	for (i = 0; i < num_lines; i++)
+		next = arena[next].line[0];
+	return next;
+}
+
+/* CPUs that share the highest-level cache with cpu, from sysfs */
+static int llc_cpus(int cpu, cpu_set_t *set, size_t set_sz)
+{
+	char path[128], buf[1024], *pos, *end;
+	int idx, level, best = -1, from, to;
+	FILE *f;
+
+	for (idx = 0; ; idx++) {
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/"
+			 "cache/index%d/level", cpu, idx);
+		f = fopen(path, "r");
+		if (!f)
+			break;
+		if (fscanf(f, "%d", &level) != 1)
+			level = -1;
+		fclose(f);
+		if (level <= best)
+			continue;
+
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/"
+			 "cache/index%d/shared_cpu_list", cpu, idx);
+		f = fopen(path, "r");
+		if (!f)
+			continue;
+		if (!fgets(buf, sizeof(buf), f)) {
+			fclose(f);
+			continue;
+		}
+		fclose(f);
+
+		/* e.g., "0-3,8-11" */
+		CPU_ZERO_S(set_sz, set);
+		for (pos = buf; *pos && *pos != '\n'; pos = end) {
+			from = to = strtol(pos, &end, 10);
+			if (end == pos)
+				break;
+			if (*end == '-')
+				to = strtol(end + 1, &end, 10);
+			for (; from <= to; from++)
+				CPU_SET_S(from, set_sz, set);
+			if (*end == ',')
+				end++;
+		}
+		best = level;
+	}
+	return best < 0 ? -1 : 0;
+}
+
+/* Pick the CPU to resume on for each level; -1 if there is none. */
+static void find_targets(int cpu, int *target)
+{
+	int ncpus = sysconf(_SC_NPROCESSORS_ONLN), i;
+	size_t set_sz = CPU_ALLOC_SIZE(ncpus);
+	cpu_set_t *llc = CPU_ALLOC(ncpus);
+
+	if (!llc)
+		die("could not allocate CPU set");
+
+	target[LEVEL_PREEMPT] = cpu;
+	target[LEVEL_SAME_LLC] = -1;
+	target[LEVEL_CROSS_LLC] = -1;
+
+	if (llc_cpus(cpu, llc, set_sz) != 0) {
+		fprintf(stderr, "Cache topology unknown, measuring "
+			"preemptions only.\n");
+		CPU_FREE(llc);
+		return;
+	}
+	for (i = 0; i < ncpus; i++) {
+		if (i == cpu)
+			continue;
+		if (CPU_ISSET_S(i, set_sz, llc)) {
+			if (target[LEVEL_SAME_LLC] < 0)
+				target[LEVEL_SAME_LLC] = i;
+		} else if (target[LEVEL_CROSS_LLC] < 0)
+			target[LEVEL_CROSS_LLC] = i;
+	}
+	CPU_FREE(llc);
+}
+
+static void* aggressor_main(void *arg)
+{
+	struct aggressor *a = arg;
+	lt_t end;
+
+	if (migrate_to(a->cpu) != 0)
+		die("could not migrate aggressor");
+	/* below the measuring thread, which preempts it upon waking up */
+	become_posix_realtime_task(1);
+
+	while (1) {
+		sem_wait(&a->go);
+		end = litmus_clock() + us2ns(delay_us);
+		while (litmus_clock() < end)
+			strided_walk_lines(a->buf, a->num_lines,
+					   sizeof(cacheline_t));
+	}
+	return NULL;
+}
+
+static void start_aggressor(struct aggressor *a, int cpu)
+{
+	a->cpu = cpu;
+	a->num_lines = aggressor_kb * 1024 / sizeof(cacheline_t);
+	a->buf = alloc_arena(aggressor_kb * 1024, 0, 0);
+	if (sem_init(&a->go, 0, 0) != 0 ||
+	    pthread_create(&a->thread, NULL, aggressor_main, a))
+		die("could not start aggressor");
+}
+
+/* cold minus warm pass for each sample, in cycles */
+static void measure(enum level level, int cpu, int target,
+		    cacheline_t *arena, int num_lines,
+		    long long *delay, long long *warm)
+{
+	cycles_t t0, t1, t2, t3;
+	volatile int sink;
+	int i;
+
+	for (i = 0; i < samples; i++) {
+		if (migrate_to(cpu) != 0)
+			die("migration failed");
+		sink = chase(arena, num_lines);
+
+		t0 = get_cycles();
+		sink = chase(arena, num_lines);
+		t1 = get_cycles();
+
+		if (aggressor_kb)
+			sem_post(&aggressors[level].go);
+		sleep_us(delay_us);
+		if (target != cpu && migrate_to(target) != 0)
+			die("migration failed");
+
+		t2 = get_cycles();
+		sink = chase(arena, num_lines);
+		t3 = get_cycles();
+
+		warm[i] = t1 - t0;
+		delay[i] = (long long) (t3 - t2) - (long long) (t1 - t0);
+	}
+	(void) sink;
+}
+
+static void report(enum level level, int wss, long long *delay,
+		   long long *warm, double us_per_cycle)
+{
+	qsort(delay, samples, sizeof(*delay), cmp_delay);
+	qsort(warm, samples, sizeof(*warm), cmp_delay);
+	printf("%-10s %8d %8d %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+	       level_label(level), wss, samples,
+	       warm[samples / 2] * us_per_cycle,
+	       delay[0] * us_per_cycle,
+	       delay[samples / 2] * us_per_cycle,
+	       delay[(int) (samples * 0.99)] * us_per_cycle,
+	       delay[(int) (samples * 0.999)] * us_per_cycle,
+	       delay[samples - 1] * us_per_cycle);
+}
+
+static int parse_wss(const char *arg, int *wss)
+{
+	char *end;
+	int n = 0;
+
+	do {
+		if (n == MAX_WSS)
+			usage("Too many working set sizes.");
+		wss[n] = strtol(arg, &end, 10);
+		if (end == arg || wss[n] <= 0 || (*end && *end != ','))
+			usage("Invalid working set size.");
+		n++;
+		arg = end + 1;
+	} while (*end);
+	return n;
+}
+
+int main(int argc, char **argv)
+{
+	int wss[MAX_WSS] = {4, 16, 64, 256, 1024, 4096, 16384};
+	int num_wss = 7, cpu = 0, target[NUM_LEVELS];
+	long long *delay, *warm;
+	cacheline_t *arena[MAX_WSS];
+	double us_per_cycle;
+	int opt, l, i;
+
+	while ((opt = getopt(argc, argv, OPTSTR)) != -1) {
+		switch (opt) {
+		case 'c':
+			cpu = atoi(optarg);
+			break;
+		case 'w':
+			num_wss = parse_wss(optarg, wss);
+			break;
+		case 'n':
+			samples = atoi(optarg);
+			if (samples <= 0)
+				usage("Invalid number of samples.");
+			break;
+		case 'd':
+			delay_us = atoi(optarg);
+			if (delay_us <= 0 || delay_us >= 1000000)
+				usage("DELAY must be between 1us and 1s.");
+			break;
+		case 'a':
+			aggressor_kb = atoi(optarg);
+			if (aggressor_kb < 0)
+				usage("Invalid aggressor working set size.");
+			break;
+		default:
+			usage("Bad argument.");
+		}
+	}
+
+	/* Build a cycle through exactly the lines of each working set before
+	 * pinning: init_arena() spreads the work over threads that would
+	 * otherwise inherit the affinity to a single CPU. */
+	for (i = 0; i < num_wss; i++) {
+		arena[i] = alloc_arena((size_t) wss[i] * 1024, 0, 0);
+		init_arena(arena[i], (size_t) wss[i] * 1024);
+	}
+
+	if (migrate_to(cpu) != 0)
+		usage("Invalid CPU.");
+	find_targets(cpu, target);
+
+	lock_memory();
+	if (become_posix_realtime_task(2) != 0)
+		fprintf(stderr, "Warning: could not become a SCHED_FIFO task, "
+			"results include preemptions by other tasks.\n");
+
+	litmus_calibrate_cycles(ms2ns(100));
+	us_per_cycle = cycles_to_ns(1000000000ULL) / 1E12;
+
+	delay = calloc(samples, sizeof(*delay));
+	warm = calloc(samples, sizeof(*warm));
+	if (!delay || !warm)
+		die("could not allocate sample buffers");
+
+	if (aggressor_kb)
+		for (l = 0; l < NUM_LEVELS; l++)
+			if (target[l] >= 0)
+				start_aggressor(&aggressors[l], target[l]);
+
+	printf("CPMD in us (job on CPU %d, suspended for %dus, aggressor "
+	       "%dKB)\n", cpu, delay_us, aggressor_kb);
+	printf("%-10s %8s %8s %10s %10s %10s %10s %10s %10s\n",
+	       "level", "wss[KB]", "samples", "warm", "min", "median",
+	       "p99", "p99.9", "max");
+	for (i = 0; i < num_wss; i++) {
+		for (l = 0; l < NUM_LEVELS; l++) {
+			if (target[l] < 0)
+				continue;
+			measure(l, cpu, target[l], arena[i],
+				wss[i] * 1024 / sizeof(cacheline_t),
+				delay, warm);
+			report(l, wss[i], delay, warm, us_per_cycle);
+		}
+	}
+	for (l = 0; l < NUM_LEVELS; l++)
+		if (target[l] < 0)
+			fprintf(stderr, "No CPU for level %s, skipped.\n",
+				level_label(l));
+
+	free(delay);
+	free(warm);
+	for (i = 0; i < num_wss; i++)
+		dealloc_arena(arena[i], (size_t) wss[i] * 1024);
+	return 0;
+}
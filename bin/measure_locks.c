@@ -0,0 +1,444 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "litmus.h"
+#include "fastpath.h"
+#include "common.h"
+
+/* Contention benchmark for short critical sections: one real-time thread per
+ * domain repeatedly acquires a single shared lock, holds it for a fixed
+ * time, and releases it. Compares the user-space non-preemptive spinlock
+ * against the in-kernel locking protocols (e.g., FMLP and MPCP).
+ *
+ * In sweep mode (-S), every protocol is run for each combination of the
+ * given numbers of domains, threads, and critical section lengths. The
+ * uncontended cost of litmus_lock()/litmus_unlock() is taken from a run with
+ * a single thread, and the blocking time of each acquisition is its latency
+ * beyond that. */
+
+#define OPTSTR "n:c:i:f:SD:T:C:"
+
+/* upper bound on the number of values of each sweep dimension */
+#define MAX_SWEEP 32
+
+/* pseudo protocol ID of the user-space spinlock */
+#define NP_SPIN -1
+
+static const char *default_protocols[] = {"NP-SPIN", "FMLP", "MPCP"};
+static const char *all_protocols[DFLP_SEM + 2];
+
+struct worker {
+	pthread_t thread;
+	int domain;
+	int protocol;
+	/* overheads of each acquisition and release, in cycles */
+	cycles_t *acquire;
+	cycles_t *release;
+	int failed;
+};
+
+static int iterations = 10000;
+static lt_t cs_length = us2ns(1);
+/* workers are spread round-robin over this many domains */
+static int use_domains;
+static const char *lock_namespace = "./measure_locks-locks";
+static struct np_spinlock *spinlock;
+static pthread_barrier_t start_barrier;
+
+static void usage(char *error)
+{
+	fprintf(stderr, "Error: %s\n", error);
+	fprintf(stderr,
+		"Usage: measure_locks [-n THREADS] [-c CS_LENGTH] "
+		"[-i ITERATIONS] [-f NAMESPACE] [PROTOCOL...]\n"
+		"       measure_locks -S [-D DOMAINS] [-T THREADS] "
+		"[-C CS_LENGTHS] [-i ITERATIONS]\n"
+		"                        [-f NAMESPACE] [PROTOCOL...]\n"
+		"\n"
+		"CS_LENGTH is in microseconds (default: 1). THREADS defaults\n"
+		"to the number of domains, one thread per domain.\n"
+		"PROTOCOL is NP-SPIN or any locking protocol supported by\n"
+		"the active plugin (default: NP-SPIN FMLP MPCP).\n"
+		"\n"
+		"-S sweeps all combinations of the comma-separated lists\n"
+		"DOMAINS (default: 1,2,4,... up to all domains), THREADS\n"
+		"(default: 1,2,4,... up to twice the domains), and\n"
+		"CS_LENGTHS (default: 1,10,100), for all protocols by default.\n");
+	exit(EXIT_FAILURE);
+}
+
+static int cmp_cycles(const void *a, const void *b)
+{
+	cycles_t x = *(const cycles_t*) a, y = *(const cycles_t*) b;
+	return (x > y) - (x < y);
+}
+
+static int parse_list(const char *arg, int *vals)
+{
+	char *end;
+	int n = 0;
+
+	do {
+		if (n == MAX_SWEEP)
+			usage("Too many values in list.");
+		vals[n] = strtol(arg, &end, 10);
+		if (end == arg || vals[n] <= 0 || (*end && *end != ','))
+			usage("Invalid list.");
+		n++;
+		arg = end + 1;
+	} while (*end);
+	return n;
+}
+
+static int cmp_int(const void *a, const void *b)
+{
+	return *(const int*) a - *(const int*) b;
+}
+
+static void* worker_main(void *arg)
+{
+	struct worker *w = arg;
+	struct rt_task param;
+	cycles_t t0, t1, t2, t3;
+	lt_t end;
+	int od = -1, i;
+
+	if (be_migrate_to_domain(w->domain) < 0)
+		goto fail;
+
+	/* never preempted by budget enforcement during the run */
+	init_rt_task_param(&param);
+	param.exec_cost = ms2ns(100);
+	param.period = ms2ns(100);
+	param.cpu = domain_to_first_cpu(w->domain);
+	param.budget_policy = NO_ENFORCEMENT;
+	if (set_rt_task_param(gettid(), &param) < 0 ||
+	    init_rt_thread() != 0 ||
+	    task_mode(LITMUS_RT_TASK) != 0)
+		goto fail;
+
+	if (w->protocol != NP_SPIN) {
+		od = litmus_open_lock(w->protocol, 0, lock_namespace,
+				      &param.cpu);
+		if (od < 0)
+			goto fail_rt;
+	}
+
+	pthread_barrier_wait(&start_barrier);
+
+	for (i = 0; i < iterations; i++) {
+		t0 = get_cycles();
+		if (w->protocol == NP_SPIN)
+			np_spin_lock_fast(spinlock);
+		else
+			litmus_lock_fast(od);
+		t1 = get_cycles();
+
+		end = cycles_clock() + cs_length;
+		while (cycles_clock() < end)
+			/* critical section */;
+
+		t2 = get_cycles();
+		if (w->protocol == NP_SPIN)
+			np_spin_unlock_fast(spinlock);
+		else
+			litmus_unlock_fast(od);
+		t3 = get_cycles();
+
+		w->acquire[i] = t1 - t0;
+		w->release[i] = t3 - t2;
+	}
+
+	if (od >= 0)
+		od_close(od);
+	task_mode(BACKGROUND_TASK);
+	return NULL;
+
+fail_rt:
+	task_mode(BACKGROUND_TASK);
+fail:
+	perror("worker setup");
+	w->failed = 1;
+	/* don't leave the others waiting */
+	pthread_barrier_wait(&start_barrier);
+	return NULL;
+}
+
+static void report(const char *name, int nthreads, cycles_t *acquire,
+		   cycles_t *release, lt_t elapsed)
+{
+	int n = nthreads * iterations;
+
+	qsort(acquire, n, sizeof(*acquire), cmp_cycles);
+	qsort(release, n, sizeof(*release), cmp_cycles);
+	printf("%-10s %7d %12.0f %10llu %10llu %10llu %10llu %10llu\n",
+	       name, nthreads, n / (elapsed / 1E9),
+	       cycles_to_ns(acquire[n / 2]),
+	       cycles_to_ns(acquire[(int) (n * 0.99)]),
+	       cycles_to_ns(acquire[n - 1]),
+	       cycles_to_ns(release[n / 2]),
+	       cycles_to_ns(release[n - 1]));
+}
+
+static int protocol_for_name(const char *name, int *protocol)
+{
+	if (!strcmp(name, "NP-SPIN"))
+		*protocol = NP_SPIN;
+	else if ((*protocol = lock_protocol_for_name(name)) < 0) {
+		fprintf(stderr, "%s: unknown locking protocol\n", name);
+		return -1;
+	}
+	return 0;
+}
+
+/* run all workers once; returns the elapsed time, or 0 on failure */
+static lt_t measure(int protocol, int nthreads, cycles_t *acquire,
+		    cycles_t *release)
+{
+	struct worker *workers;
+	lt_t start;
+	int i, failed = 0;
+
+	workers = calloc(nthreads, sizeof(*workers));
+	if (!workers)
+		bail_out("out of memory");
+
+	pthread_barrier_init(&start_barrier, NULL, nthreads + 1);
+	for (i = 0; i < nthreads; i++) {
+		workers[i].domain = i % use_domains;
+		workers[i].protocol = protocol;
+		workers[i].acquire = acquire + i * iterations;
+		workers[i].release = release + i * iterations;
+		if (pthread_create(&workers[i].thread, NULL, worker_main,
+				   &workers[i]))
+			bail_out("could not create worker thread");
+	}
+	pthread_barrier_wait(&start_barrier);
+	start = litmus_clock();
+
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		failed |= workers[i].failed;
+	}
+	pthread_barrier_destroy(&start_barrier);
+	free(workers);
+
+	return failed ? 0 : litmus_clock() - start;
+}
+
+static int run(const char *name, int nthreads, cycles_t *acquire,
+	       cycles_t *release)
+{
+	int protocol;
+	lt_t elapsed;
+
+	if (protocol_for_name(name, &protocol))
+		return -1;
+
+	elapsed = measure(protocol, nthreads, acquire, release);
+	if (!elapsed) {
+		fprintf(stderr, "%s: could not set up all workers\n", name);
+		return -1;
+	}
+	report(name, nthreads, acquire, release, elapsed);
+	return 0;
+}
+
+static void sweep(const char *name, int *domains, int ndomains,
+		 int *threads, int nthreads, int *cs, int ncs,
+		 cycles_t *acquire, cycles_t *release)
+{
+	cycles_t base_acquire, base_release;
+	lt_t elapsed;
+	int protocol, d, t, c, i, n;
+
+	if (protocol_for_name(name, &protocol))
+		return;
+
+	/* uncontended overheads: a single thread, shortest section */
+	use_domains = 1;
+	cs_length = us2ns(cs[0]);
+	if (!measure(protocol, 1, acquire, release)) {
+		fprintf(stderr, "%s: not supported by the active plugin, "
+			"skipped\n", name);
+		return;
+	}
+	qsort(acquire, iterations, sizeof(*acquire), cmp_cycles);
+	qsort(release, iterations, sizeof(*release), cmp_cycles);
+	base_acquire = acquire[iterations / 2];
+	base_release = release[iterations / 2];
+
+	for (d = 0; d < ndomains; d++)
+		for (t = 0; t < nthreads; t++)
+			for (c = 0; c < ncs; c++) {
+				use_domains = domains[d];
+				cs_length = us2ns(cs[c]);
+				elapsed = measure(protocol, threads[t],
+						  acquire, release);
+				if (!elapsed) {
+					fprintf(stderr, "%s: %d threads on %d "
+						"domains failed\n", name,
+						threads[t], domains[d]);
+					continue;
+				}
+				n = threads[t] * iterations;
+				qsort(acquire, n, sizeof(*acquire),
+				      cmp_cycles);
+				printf("%-8s %7d %7d %6d %10.0f %9llu %9llu "
+				       "%9llu",
+				       name, domains[d], threads[t], cs[c],
+				       n / (elapsed / 1E9),
+				       cycles_to_ns(acquire[n / 2]),
+				       cycles_to_ns(acquire[(int) (n * 0.99)]),
+				       cycles_to_ns(acquire[n - 1]));
+				/* blocking: latency beyond the uncontended
+				 * cost, sorted like acquire */
+				for (i = 0; i < n; i++)
+					release[i] = acquire[i] > base_acquire ?
+						acquire[i] - base_acquire : 0;
+				printf(" %9llu %9llu %9llu %9llu %9llu\n",
+				       cycles_to_ns(release[n / 2]),
+				       cycles_to_ns(release[(int) (n * 0.99)]),
+				       cycles_to_ns(release[n - 1]),
+				       cycles_to_ns(base_acquire),
+				       cycles_to_ns(base_release));
+			}
+}
+
+int main(int argc, char **argv)
+{
+	const char **protocols = default_protocols;
+	int num_protocols = 3;
+	int nthreads = 0;
+	cycles_t *acquire, *release;
+	char spin_namespace[256];
+	int opt, i, ret = 0;
+	int sweep_mode = 0, ndomains = 0, nthread_counts = 0, ncs = 0;
+	int domains[MAX_SWEEP], thread_counts[MAX_SWEEP], cs[MAX_SWEEP];
+	size_t max_threads;
+
+	while ((opt = getopt(argc, argv, OPTSTR)) != -1) {
+		switch (opt) {
+		case 'n':
+			nthreads = atoi(optarg);
+			if (nthreads <= 0)
+				usage("THREADS must be positive.");
+			break;
+		case 'c':
+			cs_length = us2ns(atoi(optarg));
+			break;
+		case 'i':
+			iterations = atoi(optarg);
+			if (iterations <= 0)
+				usage("ITERATIONS must be positive.");
+			break;
+		case 'f':
+			lock_namespace = optarg;
+			break;
+		case 'S':
+			sweep_mode = 1;
+			break;
+		case 'D':
+			ndomains = parse_list(optarg, domains);
+			break;
+		case 'T':
+			nthread_counts = parse_list(optarg, thread_counts);
+			break;
+		case 'C':
+			ncs = parse_list(optarg, cs);
+			break;
+		default:
+			usage("Bad argument.");
+		}
+	}
+	if (optind < argc) {
+		protocols = (const char**) argv + optind;
+		num_protocols = argc - optind;
+	} else if (sweep_mode) {
+		/* NP-SPIN and every entry of obj_type_t */
+		num_protocols = DFLP_SEM + 2;
+		protocols = all_protocols;
+		protocols[0] = "NP-SPIN";
+		for (i = FMLP_SEM; i <= DFLP_SEM; i++)
+			protocols[i + 1] = name_for_lock_protocol(i);
+	}
+	if (!nthreads)
+		nthreads = num_domains();
+	use_domains = num_domains();
+
+	if (sweep_mode) {
+		if (!ndomains)
+			for (i = 1; i <= num_domains() && ndomains < MAX_SWEEP;
+			     i *= 2)
+				domains[ndomains++] = i;
+		if (!nthread_counts)
+			for (i = 1; i <= 2 * num_domains() &&
+				    nthread_counts < MAX_SWEEP; i *= 2)
+				thread_counts[nthread_counts++] = i;
+		if (!ncs) {
+			cs[ncs++] = 1;
+			cs[ncs++] = 10;
+			cs[ncs++] = 100;
+		}
+		/* the uncontended run uses the shortest section */
+		qsort(cs, ncs, sizeof(int), cmp_int);
+		for (i = 0; i < ndomains; i++)
+			if (domains[i] > num_domains())
+				usage("More domains than available.");
+		nthreads = 1;
+		for (i = 0; i < nthread_counts; i++)
+			if (thread_counts[i] > nthreads)
+				nthreads = thread_counts[i];
+	}
+
+	if (init_litmus() != 0)
+		bail_out("init_litmus() failed");
+	litmus_calibrate_cycles(ms2ns(100));
+
+	snprintf(spin_namespace, sizeof(spin_namespace), "%s.spin",
+		 lock_namespace);
+	spinlock = np_spinlocks_map(spin_namespace, 1);
+	if (!spinlock)
+		bail_out("could not map spinlock");
+
+	/* preallocated, so that the measurement loop does not fault */
+	max_threads = nthreads;
+	acquire = calloc(max_threads * iterations, sizeof(*acquire));
+	release = calloc(max_threads * iterations, sizeof(*release));
+	if (!acquire || !release)
+		bail_out("out of memory");
+
+	if (sweep_mode) {
+		printf("%-8s %7s %7s %6s %10s %9s %9s %9s %9s %9s %9s "
+		       "%9s %9s\n",
+		       "protocol", "domains", "threads", "cs", "ops/s",
+		       "acq-med", "acq-p99", "acq-max", "blk-med", "blk-p99",
+		       "blk-max", "lock", "unlock");
+		printf("%-8s %7s %7s %6s %10s %9s %9s %9s %9s %9s %9s "
+		       "%9s %9s\n",
+		       "", "", "", "[us]", "", "[ns]", "[ns]", "[ns]", "[ns]",
+		       "[ns]", "[ns]", "[ns]", "[ns]");
+		for (i = 0; i < num_protocols; i++)
+			sweep(protocols[i], domains, ndomains, thread_counts,
+			      nthread_counts, cs, ncs, acquire, release);
+		goto out;
+	}
+
+	printf("%-10s %7s %12s %10s %10s %10s %10s %10s\n",
+	       "protocol", "threads", "ops/s", "acq-med", "acq-p99",
+	       "acq-max", "rel-med", "rel-max");
+	printf("%-10s %7s %12s %10s %10s %10s %10s %10s\n",
+	       "", "", "", "[ns]", "[ns]", "[ns]", "[ns]", "[ns]");
+	for (i = 0; i < num_protocols; i++)
+		if (run(protocols[i], nthreads, acquire, release))
+			ret = 1;
+
+out:
+	np_spinlocks_unmap(spinlock, 1);
+	free(acquire);
+	free(release);
+	return ret;
+}
@@ -0,0 +1,278 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "litmus.h"
+#include "fastpath.h"
+#include "common.h"
+
+/* Release jitter of periodic jobs: N tasks per CPU, all with the same
+ * period and synchronously released, timestamp the first instruction after
+ * each return from sleep_next_period() and compare it against the release
+ * time of the job from the control page. Since all tasks of a CPU are
+ * released at once, the latency of the last of them includes the release
+ * and context switch overheads of the others; sweeping N shows how the
+ * release path scales with the number of tasks. */
+
+#define OPTSTR "p:e:n:"
+
+/* time given to the tasks to reach their first release */
+#define RELEASE_DELAY ms2ns(10)
+
+struct task {
+	pthread_t thread;
+	int cpu;
+	/* per job: release latency in ns and the CPU the job woke up on */
+	long long *latency;
+	int *woke_on;
+	int jobs;
+	int failed;
+};
+
+static lt_t period = us2ns(1000);
+static lt_t exec_cost = 0;
+static int num_jobs = 1000;
+
+static void usage(char *error)
+{
+	fprintf(stderr, "Error: %s\n", error);
+	fprintf(stderr,
+		"Usage: measure_releases [-p PERIOD] [-e EXEC] [-n JOBS] "
+		"[TASKS-PER-CPU...]\n"
+		"\n"
+		"PERIOD and EXEC are in microseconds (defaults: 1000 and 0).\n"
+		"Each TASKS-PER-CPU is a load level (default: 1 2 4 8 16).\n");
+	exit(EXIT_FAILURE);
+}
+
+static int cmp_latency(const void *a, const void *b)
+{
+	long long x = *(const long long*) a, y = *(const long long*) b;
+	return (x > y) - (x < y);
+}
+
+static void* task_main(void *arg)
+{
+	struct task *t = arg;
+	struct litmus_job_info job;
+	struct rt_task param;
+	lt_t now, end;
+	int i;
+
+	if (be_migrate_to_cpu(t->cpu) < 0)
+		goto fail;
+
+	init_rt_task_param(&param);
+	param.exec_cost = exec_cost ? exec_cost : us2ns(1);
+	param.period = period;
+	param.cpu = t->cpu;
+	param.budget_policy = NO_ENFORCEMENT;
+	if (set_rt_task_param(gettid(), &param) < 0 ||
+	    init_rt_thread() != 0 ||
+	    task_mode(LITMUS_RT_TASK) != 0)
+		goto fail;
+
+	if (wait_for_ts_release() != 0) {
+		task_mode(BACKGROUND_TASK);
+		goto fail;
+	}
+
+	for (i = 0; i < num_jobs; i++) {
+		if (i && sleep_next_period_fast() != 0)
+			break;
+		now = cycles_clock();
+		if (get_job_info(&job) != 0)
+			break;
+		t->latency[i] = (long long) now - (long long) job.release;
+		t->woke_on[i] = sched_getcpu();
+
+		end = now + exec_cost;
+		while (exec_cost && cycles_clock() < end)
+			/* job body */;
+	}
+	t->jobs = i;
+
+	task_mode(BACKGROUND_TASK);
+	return NULL;
+
+fail:
+	perror("task setup");
+	t->failed = 1;
+	return NULL;
+}
+
+static void report_row(int load, const char *cpu, long long *lat, long n)
+{
+	if (!n)
+		return;
+	qsort(lat, n, sizeof(*lat), cmp_latency);
+	printf("%5d %5s %10ld %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+	       load, cpu, n,
+	       lat[0] / 1E3,
+	       lat[n / 2] / 1E3,
+	       lat[(long) (n * 0.99)] / 1E3,
+	       lat[(long) (n * 0.999)] / 1E3,
+	       lat[n - 1] / 1E3);
+}
+
+static void report(int load, struct task *tasks, int ntasks, int ncpus)
+{
+	long long *lat;
+	long n = 0, total = 0;
+	char name[16];
+	int cpu, i, j;
+
+	for (i = 0; i < ntasks; i++)
+		total += tasks[i].jobs;
+	lat = malloc((total ? total : 1) * sizeof(*lat));
+	if (!lat)
+		bail_out("out of memory");
+
+	/* jobs are attributed to the CPU they actually woke up on */
+	for (cpu = 0; cpu < ncpus; cpu++) {
+		n = 0;
+		for (i = 0; i < ntasks; i++)
+			for (j = 0; j < tasks[i].jobs; j++)
+				if (tasks[i].woke_on[j] == cpu)
+					lat[n++] = tasks[i].latency[j];
+		snprintf(name, sizeof(name), "%d", cpu);
+		report_row(load, name, lat, n);
+	}
+
+	n = 0;
+	for (i = 0; i < ntasks; i++)
+		for (j = 0; j < tasks[i].jobs; j++)
+			lat[n++] = tasks[i].latency[j];
+	report_row(load, "all", lat, n);
+
+	free(lat);
+}
+
+static int run(int load, int ncpus)
+{
+	struct task *tasks;
+	lt_t delay = RELEASE_DELAY;
+	int ntasks = load * ncpus, i, waiting, failed = 0;
+
+	tasks = calloc(ntasks, sizeof(*tasks));
+	if (!tasks)
+		bail_out("out of memory");
+
+	for (i = 0; i < ntasks; i++) {
+		tasks[i].cpu = i % ncpus;
+		/* preallocated, so that the job loop does not fault */
+		tasks[i].latency = calloc(num_jobs, sizeof(long long));
+		tasks[i].woke_on = calloc(num_jobs, sizeof(int));
+		if (!tasks[i].latency || !tasks[i].woke_on)
+			bail_out("out of memory");
+		if (pthread_create(&tasks[i].thread, NULL, task_main,
+				   &tasks[i]))
+			bail_out("could not create task thread");
+	}
+
+	waiting = wait_for_nr_ts_release_waiters(ntasks, s2ns(10));
+	if (waiting < ntasks)
+		failed = 1;
+	/* release whoever made it, so that all threads terminate */
+	if (waiting > 0)
+		release_ts(&delay);
+
+	for (i = 0; i < ntasks; i++) {
+		pthread_join(tasks[i].thread, NULL);
+		failed |= tasks[i].failed;
+	}
+
+	if (failed)
+		fprintf(stderr, "%d tasks per CPU: could not set up all "
+			"tasks\n", load);
+	else
+		report(load, tasks, ntasks, ncpus);
+
+	for (i = 0; i < ntasks; i++) {
+		free(tasks[i].latency);
+		free(tasks[i].woke_on);
+	}
+	free(tasks);
+	return failed ? -1 : 0;
+}
+
+static void print_plugin(void)
+{
+	char name[64] = "unknown";
+	FILE *f;
+
+	f = fopen("/proc/litmus/active_plugin", "r");
+	if (f) {
+		if (fscanf(f, "%63s", name) != 1)
+			strcpy(name, "unknown");
+		fclose(f);
+	}
+	printf("plugin %s, period %lluus, exec %lluus, %d jobs per task\n",
+	       name, period / 1000, exec_cost / 1000, num_jobs);
+}
+
+int main(int argc, char **argv)
+{
+	static const int default_loads[] = {1, 2, 4, 8, 16};
+	int num_loads = 5, *loads, ncpus, opt, i, us, ret = 0;
+
+	while ((opt = getopt(argc, argv, OPTSTR)) != -1) {
+		switch (opt) {
+		case 'p':
+			us = atoi(optarg);
+			if (us <= 0)
+				usage("Invalid period.");
+			period = us2ns(us);
+			break;
+		case 'e':
+			us = atoi(optarg);
+			if (us < 0)
+				usage("Invalid execution cost.");
+			exec_cost = us2ns(us);
+			break;
+		case 'n':
+			num_jobs = atoi(optarg);
+			if (num_jobs <= 0)
+				usage("Invalid number of jobs.");
+			break;
+		default:
+			usage("Bad argument.");
+		}
+	}
+
+	loads = malloc(sizeof(int) * (optind < argc ? argc - optind : 5));
+	if (!loads)
+		bail_out("out of memory");
+	if (optind < argc) {
+		num_loads = argc - optind;
+		for (i = 0; i < num_loads; i++) {
+			loads[i] = atoi(argv[optind + i]);
+			if (loads[i] <= 0)
+				usage("TASKS-PER-CPU must be positive.");
+		}
+	} else
+		memcpy(loads, default_loads, sizeof(default_loads));
+
+	for (i = 0; i < num_loads; i++)
+		if (loads[i] * exec_cost >= period)
+			usage("Load level exceeds 100% utilization.");
+
+	if (init_litmus() != 0)
+		bail_out("init_litmus() failed");
+	litmus_calibrate_cycles(ms2ns(100));
+	ncpus = num_online_cpus();
+
+	print_plugin();
+	printf("release latency in us\n");
+	printf("%5s %5s %10s %10s %10s %10s %10s %10s\n",
+	       "tasks", "cpu", "jobs", "min", "median", "p99", "p99.9", "max");
+	for (i = 0; i < num_loads; i++)
+		if (run(loads[i], ncpus))
+			ret = 1;
+
+	free(loads);
+	return ret;
+}
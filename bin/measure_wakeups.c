@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "litmus.h"
+#include "common.h"
+
+/* Wake-up error of periodic sleeps: relative lt_sleep(), absolute
+ * lt_sleep_until(), and lt_sleep_until_hybrid() with a given margin. */
+
+#define OPTSTR "n:p:m:"
+
+enum sleep_mode {
+	MODE_RELATIVE,
+	MODE_ABSOLUTE,
+	MODE_HYBRID,
+	NUM_MODES
+};
+
+static const char* mode_name[NUM_MODES] = {
+	"lt_sleep",
+	"lt_sleep_until",
+	"hybrid",
+};
+
+static void usage(char *error)
+{
+	fprintf(stderr, "Error: %s\n", error);
+	fprintf(stderr,
+		"Usage: measure_wakeups [-n SAMPLES] [-p PERIOD] [-m MARGIN]\n"
+		"\n"
+		"PERIOD and MARGIN are in microseconds "
+		"(defaults: 1000 and 50).\n");
+	exit(EXIT_FAILURE);
+}
+
+static int cmp_error(const void *a, const void *b)
+{
+	long long x = *(const long long*) a, y = *(const long long*) b;
+	return (x > y) - (x < y);
+}
+
+/* error of each wake-up w.r.t. the k-th period boundary, in ns */
+static void run(enum sleep_mode mode, long long *err, int samples,
+		lt_t period, lt_t margin)
+{
+	lt_t start, next;
+	int i;
+
+	start = litmus_clock();
+	next = start;
+	for (i = 0; i < samples; i++) {
+		next += period;
+		switch (mode) {
+		case MODE_RELATIVE:
+			/* the naive way: drifts by the wake-up latency */
+			lt_sleep(period);
+			break;
+		case MODE_ABSOLUTE:
+			lt_sleep_until(next);
+			break;
+		default:
+			lt_sleep_until_hybrid(next, margin);
+			break;
+		}
+		err[i] = (long long) litmus_clock() - (long long) next;
+	}
+}
+
+static void report(enum sleep_mode mode, long long *err, int samples)
+{
+	qsort(err, samples, sizeof(*err), cmp_error);
+	printf("%-15s %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+	       mode_name[mode],
+	       err[0] / 1E3,
+	       err[samples / 2] / 1E3,
+	       err[(int) (samples * 0.99)] / 1E3,
+	       err[(int) (samples * 0.999)] / 1E3,
+	       err[samples - 1] / 1E3);
+}
+
+int main(int argc, char** argv)
+{
+	int samples = 10000, opt, m, us;
+	lt_t period = us2ns(1000), margin = us2ns(50);
+	long long *err;
+
+	while ((opt = getopt(argc, argv, OPTSTR)) != -1) {
+		switch (opt) {
+		case 'n':
+			samples = atoi(optarg);
+			if (samples <= 0)
+				usage("Invalid number of samples.");
+			break;
+		case 'p':
+			us = atoi(optarg);
+			if (us <= 0)
+				usage("Invalid period.");
+			period = us2ns(us);
+			break;
+		case 'm':
+			us = atoi(optarg);
+			if (us < 0)
+				usage("Invalid margin.");
+			margin = us2ns(us);
+			break;
+		case ':':
+			usage("Argument missing.");
+			break;
+		case '?':
+		default:
+			usage("Bad argument.");
+			break;
+		}
+	}
+
+	err = calloc(samples, sizeof(*err));
+	if (!err)
+		bail_out("couldn't allocate memory");
+
+	printf("wake-up error in us (period %lluus, hybrid margin %lluus)\n",
+	       period / 1000, margin / 1000);
+	printf("%-15s %10s %10s %10s %10s %10s\n",
+	       "mode", "min", "median", "p99", "p99.9", "max");
+	for (m = 0; m < NUM_MODES; m++) {
+		run(m, err, samples, period, margin);
+		report(m, err, samples);
+	}
+
+	free(err);
+	return 0;
+}
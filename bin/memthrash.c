@@ -7,23 +7,157 @@
 #include <sys/resource.h>
 #include <unistd.h>
 #include <sched.h>
+#include <pthread.h>
 
 #include <time.h>
 
+#include "litmus.h"
 #include "cache_common.h"
 
-#define NUM_VARS   (8388608*2)
+/* Memory bandwidth aggressor: one thread per CPU streams over its own buffer
+ * with a read, write, or copy pattern, optionally throttled to a target
+ * bandwidth, while the main thread reports the achieved bandwidth. */
 
-int64_t data[NUM_VARS];
+/* unit of work between rate checks */
+#define CHUNK_BYTES (64 * 1024)
+/* how far a thread that fell behind may burst to catch up */
+#define MAX_CATCH_UP ms2ns(10)
 
-#define OPTSTR "m:"
-int main(int argc, char** argv)
+enum pattern {
+        PATTERN_READ,
+        PATTERN_WRITE,
+        PATTERN_COPY,
+};
+
+static const char *pattern_names[] = {"read", "write", "copy"};
+
+struct aggressor {
+        pthread_t thread;
+        int cpu;
+        /* bytes moved so far; copies count reads and writes */
+        volatile uint64_t bytes;
+        int64_t sink;
+};
+
+static enum pattern pattern = PATTERN_READ;
+static size_t footprint = 128 * 1024 * 1024;
+static double rate_mbps = 0; /* per thread, 0 means unthrottled */
+static volatile int stop = 0;
+
+static void usage(char *error)
+{
+        fprintf(stderr, "Error: %s\n", error);
+        fprintf(stderr,
+                "Usage: memthrash [-m CPU | -d DOMAIN] [-r MBPS | -R MBPS]\n"
+                "                 [-p read|write|copy] [-s FOOTPRINT] "
+                "[-i INTERVAL] [DURATION]\n"
+                "\n"
+                "-m runs one thread on CPU, -d one thread on each CPU of\n"
+                "   DOMAIN; otherwise a single thread runs anywhere.\n"
+                "-r limits each thread to MBPS megabytes per second,\n"
+                "-R limits all threads together (default: unthrottled).\n"
+                "   Copies count both the bytes read and the bytes written.\n"
+                "FOOTPRINT is the buffer size of each thread in KB "
+                "(default: 131072).\n"
+                "INTERVAL is the reporting period in ms (default: 1000).\n"
+                "DURATION is in seconds (default: run until killed).\n");
+        exit(EXIT_FAILURE);
+}
+
+static int64_t read_chunk(const int64_t *p, size_t words)
+{
+        int64_t sum = 0;
+        size_t i;
+
+        for (i = 0; i < words; i++)
+                sum += p[i];
+        return sum;
+}
+
+static void write_chunk(int64_t *p, size_t words, int64_t val)
+{
+        size_t i;
+
+        for (i = 0; i < words; i++)
+                p[i] = val;
+}
+
+static void* aggressor_main(void *arg)
 {
-        int i;
-        int64_t sum;
+        struct aggressor *a = arg;
+        char *buf;
+        size_t span, pos = 0;
+        uint64_t done = 0;
+        lt_t start, due, now;
+
+        if (a->cpu >= 0 && migrate_to(a->cpu) != 0)
+                die("could not migrate to CPU");
 
-        int cpu = -1;
-        int opt;
+        /* allocated after migrating, so that it is local on NUMA systems */
+        buf = mmap(0, footprint, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if (buf == MAP_FAILED)
+                die("could not allocate buffer");
+
+        /* a copy reads the first half and writes the second */
+        span = pattern == PATTERN_COPY ? footprint / 2 : footprint;
+        span -= span % CHUNK_BYTES;
+        if (!span)
+                die("footprint too small");
+
+        start = litmus_clock();
+        while (!stop) {
+                switch (pattern) {
+                case PATTERN_READ:
+                        a->sink += read_chunk((int64_t*) (buf + pos),
+                                              CHUNK_BYTES / sizeof(int64_t));
+                        done += CHUNK_BYTES;
+                        break;
+                case PATTERN_WRITE:
+                        write_chunk((int64_t*) (buf + pos),
+                                    CHUNK_BYTES / sizeof(int64_t), done);
+                        done += CHUNK_BYTES;
+                        break;
+                case PATTERN_COPY:
+                        memcpy(buf + span + pos, buf + pos, CHUNK_BYTES);
+                        done += 2 * CHUNK_BYTES;
+                        break;
+                }
+                a->bytes = done;
+                pos = (pos + CHUNK_BYTES) % span;
+
+                if (rate_mbps > 0) {
+                        /* when the bytes moved so far are due */
+                        due = start + (lt_t) (done * 1E3 / rate_mbps);
+                        now = litmus_clock();
+                        if (due > now)
+                                lt_sleep_until(due);
+                        else if (now - due > MAX_CATCH_UP)
+                                start += now - due - MAX_CATCH_UP;
+                }
+        }
+
+        munmap(buf, footprint);
+        return NULL;
+}
+
+static double mbps(uint64_t bytes, lt_t ns)
+{
+        return ns ? bytes / (ns / 1E3) : 0;
+}
+
+#define OPTSTR "m:d:r:R:p:s:i:"
+int main(int argc, char** argv)
+{
+        struct aggressor *threads;
+        uint64_t *last, bytes, total;
+        int nthreads = 1;
+        int cpu = -1, domain = -1;
+        double total_mbps = 0;
+        lt_t interval = ms2ns(1000), duration = 0, start, prev, now;
+        cpu_set_t *cpus = NULL;
+        size_t cpus_sz = 0;
+        int opt, i, c;
 
         while ((opt = getopt(argc, argv, OPTSTR)) != -1)
         {
@@ -32,31 +166,121 @@ int main(int argc, char** argv)
                 case 'm':
                         cpu = atoi(optarg);
                         break;
+                case 'd':
+                        domain = atoi(optarg);
+                        break;
+                case 'r':
+                        rate_mbps = atof(optarg);
+                        if (rate_mbps <= 0)
+                                usage("MBPS must be positive.");
+                        break;
+                case 'R':
+                        total_mbps = atof(optarg);
+                        if (total_mbps <= 0)
+                                usage("MBPS must be positive.");
+                        break;
+                case 'p':
+                        for (i = 0; i < 3; i++)
+                                if (!strcmp(optarg, pattern_names[i]))
+                                        break;
+                        if (i == 3)
+                                usage("Unknown pattern.");
+                        pattern = i;
+                        break;
+                case 's':
+                        footprint = (size_t) atol(optarg) * 1024;
+                        break;
+                case 'i':
+                        interval = ms2ns(atoi(optarg));
+                        if (!interval)
+                                usage("INTERVAL must be positive.");
+                        break;
                 case ':':
                 case '?':
                 default:
-                        printf("Bad or missing argument.\n");
-                        exit(-1);
+                        usage("Bad or missing argument.");
                 }
         }
+        if (optind < argc)
+                duration = s2ns(atof(argv[optind]));
+        if (cpu >= 0 && domain >= 0)
+                usage("-m and -d are mutually exclusive.");
+        if (rate_mbps > 0 && total_mbps > 0)
+                usage("-r and -R are mutually exclusive.");
 
-        srand(time(NULL));
+        if (domain >= 0) {
+                cpus_sz = CPU_ALLOC_SIZE(num_online_cpus());
+                cpus = CPU_ALLOC(num_online_cpus());
+                if (!cpus || domain_to_cpuset(domain, cpus_sz, cpus) != 0)
+                        die("could not determine the CPUs of the domain");
+                nthreads = CPU_COUNT_S(cpus_sz, cpus);
+                if (!nthreads)
+                        die("the domain has no online CPUs");
+        }
+        if (total_mbps > 0)
+                rate_mbps = total_mbps / nthreads;
 
-        if(cpu != -1)
-                migrate_to(cpu);
+        threads = calloc(nthreads, sizeof(*threads));
+        last = calloc(nthreads, sizeof(*last));
+        if (!threads || !last)
+                die("out of memory");
 
         lock_memory();
         renice(-20); /* meanest task around */
 
-        while (1) {
-                for (i = 0; i < NUM_VARS; i++)
-                        data[i] = rand();
-                sum = 0;
-                for (i = 0; i < NUM_VARS; i++)
-                        sum += (i % 2 ? 1 : -1) * data[i];
-                for (i = NUM_VARS - 1; i >= 0; i--)
-                        sum += (i % 2 ? -1 : 1) * 100  /  (data[i] ? data[i] : 1);
+        for (i = 0, c = 0; i < nthreads; i++, c++) {
+                if (cpus) {
+                        while (!CPU_ISSET_S(c, cpus_sz, cpus))
+                                c++;
+                        threads[i].cpu = c;
+                } else
+                        threads[i].cpu = cpu;
+                if (pthread_create(&threads[i].thread, NULL, aggressor_main,
+                                   &threads[i]))
+                        die("could not start thread");
+        }
+
+        printf("%d thread(s), %s, %zu KB each, ",
+               nthreads, pattern_names[pattern], footprint / 1024);
+        if (rate_mbps > 0)
+                printf("target %.1f MB/s each\n", rate_mbps);
+        else
+                printf("unthrottled\n");
+
+        start = prev = litmus_clock();
+        while (!duration || prev - start < duration) {
+                now = prev + interval;
+                if (duration && now > start + duration)
+                        now = start + duration;
+                lt_sleep_until(now);
+                now = litmus_clock();
+
+                total = 0;
+                printf("%8.1fs", (now - start) / 1E9);
+                for (i = 0; i < nthreads; i++) {
+                        bytes = threads[i].bytes;
+                        total += bytes - last[i];
+                        if (nthreads > 1)
+                                printf(" %8.1f", mbps(bytes - last[i],
+                                                      now - prev));
+                        last[i] = bytes;
+                }
+                printf(" %10.1f MB/s\n", mbps(total, now - prev));
+                fflush(stdout);
+                prev = now;
+        }
+
+        stop = 1;
+        total = 0;
+        for (i = 0; i < nthreads; i++) {
+                pthread_join(threads[i].thread, NULL);
+                total += threads[i].bytes;
         }
+        printf("average: %.1f MB/s\n", mbps(total, litmus_clock() - start));
 
+        if (cpus)
+                CPU_FREE(cpus);
+        free(threads);
+        free(last);
         return 0;
-}
\ No newline at end of file
+}
@@ -3,8 +3,12 @@
 #include <stdlib.h>
 #include <time.h>
 #include <math.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
 
 #include "litmus.h"
+#include "fastpath.h"
 
 static void time_null_call(void)
 {
@@ -25,6 +29,284 @@ static void time_null_call(void)
 	       t0, t1, t2, t1 - t0, t2 - t1, t2 - t0);
 }
 
+enum call_variant {
+	VIA_GLIBC,	/* glibc's variadic syscall() */
+	VIA_LIBRARY,	/* out-of-line null_call() in liblitmus */
+	VIA_INLINE,	/* null_call_fast() from fastpath.h */
+	NUM_VARIANTS
+};
+
+static const char* variant_name[NUM_VARIANTS] = {
+	"syscall()",
+	"null_call()",
+	"null_call_fast()",
+};
+
+static int cmp_cycles(const void *a, const void *b)
+{
+	cycles_t x = *(const cycles_t*) a, y = *(const cycles_t*) b;
+	return (x > y) - (x < y);
+}
+
+static int do_null_call(enum call_variant how, cycles_t *ts)
+{
+	switch (how) {
+	case VIA_GLIBC:
+		return syscall(__NR_null_call, ts);
+	case VIA_LIBRARY:
+		return null_call(ts);
+	default:
+		return null_call_fast(ts);
+	}
+}
+
+/* Back-to-back comparison of the three ways of entering the kernel. Variants
+ * are interleaved so that each sees the same cache and frequency state. */
+static void compare_call_paths(int samples)
+{
+	cycles_t *total[NUM_VARIANTS], *entry[NUM_VARIANTS];
+	cycles_t t0, t1, t2;
+	int i, v;
+
+	for (v = 0; v < NUM_VARIANTS; v++) {
+		total[v] = calloc(samples, sizeof(cycles_t));
+		entry[v] = calloc(samples, sizeof(cycles_t));
+		if (!total[v] || !entry[v]) {
+			perror("calloc");
+			exit(1);
+		}
+	}
+
+	for (i = 0; i < samples; i++)
+		for (v = 0; v < NUM_VARIANTS; v++) {
+			t0 = get_cycles();
+			if (do_null_call(v, &t1) != 0) {
+				perror("null_call");
+				exit(1);
+			}
+			t2 = get_cycles();
+			total[v][i] = t2 - t0;
+			entry[v][i] = t1 - t0;
+		}
+
+	printf("%-18s %10s %10s %10s %10s\n",
+	       "variant", "min", "median", "entry-med", "saved-med");
+	for (v = 0; v < NUM_VARIANTS; v++) {
+		qsort(total[v], samples, sizeof(cycles_t), cmp_cycles);
+		qsort(entry[v], samples, sizeof(cycles_t), cmp_cycles);
+	}
+	for (v = 0; v < NUM_VARIANTS; v++)
+		printf("%-18s %10" CYCLES_FMT " %10" CYCLES_FMT
+		       " %10" CYCLES_FMT " %10lld\n",
+		       variant_name[v], total[v][0], total[v][samples / 2],
+		       entry[v][samples / 2],
+		       (long long) total[VIA_GLIBC][samples / 2]
+		       - (long long) total[v][samples / 2]);
+
+	for (v = 0; v < NUM_VARIANTS; v++) {
+		free(total[v]);
+		free(entry[v]);
+	}
+}
+
+/* Benchmark mode: one thread per CPU collects samples into preallocated
+ * buffers, dropping samples during which an interrupt was handled. */
+
+enum output_format {
+	OUTPUT_TABLE,
+	OUTPUT_CSV,
+	OUTPUT_JSON,
+};
+
+enum metric {
+	METRIC_ENTRY,
+	METRIC_EXIT,
+	METRIC_TOTAL,
+	NUM_METRICS
+};
+
+static const char* metric_name[NUM_METRICS] = {"entry", "exit", "total"};
+
+struct cpu_bench {
+	pthread_t thread;
+	int cpu;
+	cycles_t *samples[NUM_METRICS];
+	long kept;
+	/* samples discarded because irq_count changed */
+	long filtered;
+	int failed;
+};
+
+static pthread_barrier_t bench_barrier;
+static long bench_samples;
+
+static void* bench_cpu(void *arg)
+{
+	struct cpu_bench *b = arg;
+	volatile struct control_page *cp;
+	cycles_t t0, t1, t2;
+	uint64_t irqs;
+	long attempts = 0;
+	int m;
+
+	if (be_migrate_to_cpu(b->cpu) < 0 || !(cp = get_ctrl_page())) {
+		b->failed = 1;
+		pthread_barrier_wait(&bench_barrier);
+		return NULL;
+	}
+
+	/* allocate and fault in the buffers on the measured CPU */
+	for (m = 0; m < NUM_METRICS; m++) {
+		b->samples[m] = malloc(bench_samples * sizeof(cycles_t));
+		if (!b->samples[m]) {
+			perror("malloc");
+			exit(1);
+		}
+		memset(b->samples[m], 0, bench_samples * sizeof(cycles_t));
+	}
+
+	/* start all CPUs together */
+	pthread_barrier_wait(&bench_barrier);
+
+	while (b->kept < bench_samples && attempts++ < 10 * bench_samples) {
+		irqs = cp->irq_count;
+		t0 = get_cycles();
+		if (null_call_fast(&t1) != 0) {
+			b->failed = 1;
+			break;
+		}
+		t2 = get_cycles();
+		if (cp->irq_count != irqs) {
+			b->filtered++;
+			continue;
+		}
+		b->samples[METRIC_ENTRY][b->kept] = t1 - t0;
+		b->samples[METRIC_EXIT][b->kept] = t2 - t1;
+		b->samples[METRIC_TOTAL][b->kept] = t2 - t0;
+		b->kept++;
+	}
+	return NULL;
+}
+
+static void print_results(struct cpu_bench *cpus, int ncpus,
+			  enum output_format format)
+{
+	struct cpu_bench *b;
+	cycles_t *s;
+	long n;
+	int i, m;
+
+	if (format == OUTPUT_TABLE)
+		printf("%4s %-6s %10s %9s %8s %8s %8s %8s %10s\n", "cpu",
+		       "metric", "samples", "filtered", "min", "median",
+		       "p99", "p99.9", "max");
+	else if (format == OUTPUT_CSV)
+		printf("cpu,metric,samples,filtered,"
+		       "min,median,p99,p99.9,max\n");
+	else
+		printf("{\"unit\": \"cycles\", \"results\": [");
+
+	for (i = 0; i < ncpus; i++) {
+		b = &cpus[i];
+		n = b->kept;
+		if (format == OUTPUT_JSON)
+			printf("%s\n  {\"cpu\": %d, \"samples\": %ld, "
+			       "\"filtered\": %ld", i ? "," : "", b->cpu, n,
+			       b->filtered);
+		for (m = 0; m < NUM_METRICS && n; m++) {
+			s = b->samples[m];
+			qsort(s, n, sizeof(cycles_t), cmp_cycles);
+			switch (format) {
+			case OUTPUT_TABLE:
+				printf("%4d %-6s %10ld %9ld %8" CYCLES_FMT
+				       " %8" CYCLES_FMT " %8" CYCLES_FMT
+				       " %8" CYCLES_FMT " %10" CYCLES_FMT "\n",
+				       b->cpu, metric_name[m], n, b->filtered,
+				       s[0], s[n / 2], s[(long) (n * 0.99)],
+				       s[(long) (n * 0.999)], s[n - 1]);
+				break;
+			case OUTPUT_CSV:
+				printf("%d,%s,%ld,%ld,%" CYCLES_FMT ",%"
+				       CYCLES_FMT ",%" CYCLES_FMT ",%"
+				       CYCLES_FMT ",%" CYCLES_FMT "\n",
+				       b->cpu, metric_name[m], n, b->filtered,
+				       s[0], s[n / 2], s[(long) (n * 0.99)],
+				       s[(long) (n * 0.999)], s[n - 1]);
+				break;
+			case OUTPUT_JSON:
+				printf(", \"%s\": {\"min\": %" CYCLES_FMT
+				       ", \"median\": %" CYCLES_FMT
+				       ", \"p99\": %" CYCLES_FMT
+				       ", \"p99.9\": %" CYCLES_FMT
+				       ", \"max\": %" CYCLES_FMT "}",
+				       metric_name[m], s[0], s[n / 2],
+				       s[(long) (n * 0.99)],
+				       s[(long) (n * 0.999)], s[n - 1]);
+				break;
+			}
+		}
+		if (format == OUTPUT_JSON)
+			printf("}");
+	}
+	if (format == OUTPUT_JSON)
+		printf("\n]}\n");
+}
+
+static int benchmark(long samples, int domain, enum output_format format)
+{
+	struct cpu_bench *cpus;
+	cpu_set_t *set;
+	size_t set_sz;
+	int ncpus = 0, online = num_online_cpus(), cpu, i, m, ret = 0;
+
+	set_sz = CPU_ALLOC_SIZE(online);
+	set = CPU_ALLOC(online);
+	cpus = calloc(online, sizeof(*cpus));
+	if (!set || !cpus) {
+		perror("calloc");
+		return 1;
+	}
+	if (domain >= 0) {
+		if (domain_to_cpuset(domain, set_sz, set) != 0) {
+			fprintf(stderr, "Invalid domain: %d\n", domain);
+			return 1;
+		}
+	} else {
+		CPU_ZERO_S(set_sz, set);
+		for (cpu = 0; cpu < online; cpu++)
+			CPU_SET_S(cpu, set_sz, set);
+	}
+	for (cpu = 0; cpu < online; cpu++)
+		if (CPU_ISSET_S(cpu, set_sz, set))
+			cpus[ncpus++].cpu = cpu;
+
+	bench_samples = samples;
+	pthread_barrier_init(&bench_barrier, NULL, ncpus);
+	for (i = 0; i < ncpus; i++)
+		if (pthread_create(&cpus[i].thread, NULL, bench_cpu, &cpus[i])) {
+			perror("pthread_create");
+			exit(1);
+		}
+	for (i = 0; i < ncpus; i++) {
+		pthread_join(cpus[i].thread, NULL);
+		if (cpus[i].failed) {
+			fprintf(stderr, "CPU %d: measurement failed\n",
+				cpus[i].cpu);
+			ret = 1;
+		}
+	}
+	pthread_barrier_destroy(&bench_barrier);
+
+	print_results(cpus, ncpus, format);
+
+	for (i = 0; i < ncpus; i++)
+		for (m = 0; m < NUM_METRICS; m++)
+			free(cpus[i].samples[m]);
+	free(cpus);
+	CPU_FREE(set);
+	return ret;
+}
+
 static struct timespec sec2timespec(double seconds)
 {
 	struct timespec tspec;
@@ -34,16 +316,78 @@ static struct timespec sec2timespec(double seconds)
 	return tspec;
 }
 
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-c SAMPLES] [DELAY]\n"
+		"       %s -b SAMPLES [-d DOMAIN] [-o table|csv|json]\n"
+		"\n"
+		"-b collects SAMPLES null_call()s on every CPU (of DOMAIN) at\n"
+		"   once and reports the distribution of the entry, exit, and\n"
+		"   total overheads in cycles, discarding samples that were\n"
+		"   interrupted.\n", prog, prog);
+	exit(1);
+}
+
+#define OPTSTR "c:b:d:o:"
+
 int main(int argc, char **argv)
 {
 	double delay;
 	struct timespec sleep_time;
-	
-	if (argc == 2) {
-		delay = atof(argv[1]);
+	int opt, samples = 0, domain = -1;
+	long bench = 0;
+	enum output_format format = OUTPUT_TABLE;
+
+	while ((opt = getopt(argc, argv, OPTSTR)) != -1) {
+		switch (opt) {
+		case 'c':
+			samples = atoi(optarg);
+			if (samples <= 0) {
+				fprintf(stderr, "Invalid sample count: %s\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 'b':
+			bench = atol(optarg);
+			if (bench <= 0) {
+				fprintf(stderr, "Invalid sample count: %s\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 'd':
+			domain = atoi(optarg);
+			break;
+		case 'o':
+			if (!strcmp(optarg, "csv"))
+				format = OUTPUT_CSV;
+			else if (!strcmp(optarg, "json"))
+				format = OUTPUT_JSON;
+			else if (!strcmp(optarg, "table"))
+				format = OUTPUT_TABLE;
+			else
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (bench)
+		return benchmark(bench, domain, format);
+
+	if (samples) {
+		compare_call_paths(samples);
+		return 0;
+	}
+
+	if (argc - optind == 1) {
+		delay = atof(argv[optind]);
 		sleep_time = sec2timespec(delay);
 		if (delay <= 0.0)
-			fprintf(stderr, "Invalid time spec: %s\n", argv[1]);
+			fprintf(stderr, "Invalid time spec: %s\n", argv[optind]);
 		fprintf(stderr, "Measuring syscall overhead every "
 			"%lus and %luns.\n",
 			(unsigned long) sleep_time.tv_sec,
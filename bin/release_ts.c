@@ -9,9 +9,7 @@
 #include "litmus.h"
 #include "internal.h"
 
-#define OPTSTR "d:wf:"
-
-#define LITMUS_STATS_FILE "/proc/litmus/stats"
+#define OPTSTR "d:wf:t:"
 
 void usage(char *error) {
 	fprintf(stderr,
@@ -22,22 +20,19 @@ void usage(char *error) {
 		"         -w  wait until all tasks are ready for release\n"
 		"             (as determined by /proc/litmus/stats\n"
 		"         -f  <#tasks> wait for #tasks (default: 0)\n"
+		"         -t  <timeout in ms> give up waiting after timeout\n"
+		"             (default: wait forever)\n"
 		"\n",
 		error);
 	exit(1);
 }
 
-void wait_until_ready(int expected)
+void wait_until_ready(int expected, lt_t timeout)
 {
-	int ready = 0, all = 0;
-	int loops = 0;
-
-	do {
-		if (loops++ > 0)
-			sleep(1);
-		if (!read_litmus_stats(&ready, &all))
-			perror("read_litmus_stats");
-	} while (expected > ready || (!expected && ready < all));
+	if (wait_for_nr_ts_release_waiters(expected, timeout) < 0) {
+		perror("waiting for tasks");
+		exit(1);
+	}
 }
 
 int main(int argc, char** argv)
@@ -46,7 +41,8 @@ int main(int argc, char** argv)
 	lt_t delay = ms2ns(1000);
 	int wait = 0;
 	int expected = 0;
-	int opt;
+	lt_t timeout = 0;
+	int opt, ms;
       
 	while ((opt = getopt(argc, argv, OPTSTR)) != -1) {
 		switch (opt) {
@@ -60,6 +56,12 @@ int main(int argc, char** argv)
 			wait = 1;
 			expected = atoi(optarg);
 			break;
+		case 't':
+			ms = atoi(optarg);
+			if (ms < 0)
+				usage("Invalid timeout.");
+			timeout = ms2ns(ms);
+			break;
 		case ':':
 			usage("Argument missing.");
 			break;
@@ -71,7 +73,7 @@ int main(int argc, char** argv)
 	}
 
 	if (wait)
-		wait_until_ready(expected);
+		wait_until_ready(expected, timeout);
 
 	released = release_ts(&delay);
 	if (released < 0) {
@@ -6,7 +6,6 @@
 #include <unistd.h>
 #include <time.h>
 #include <string.h>
-#include <assert.h>
 #include <limits.h>
 
 
@@ -35,6 +34,7 @@ typedef cacheline_t* (*walk_start_t)(int wss);
 
 struct walk_method
 {
+	const char *name;
 	const walk_t walk;
 	const walk_start_t walk_start;
 };
@@ -89,6 +89,7 @@ static cacheline_t* sequential_start(int wss)
 
 static const struct walk_method sequential_method =
 {
+	.name = "sequential",
 	.walk = sequential_walk,
 	.walk_start = sequential_start
 };
@@ -153,96 +154,139 @@ static cacheline_t* random_start(int wss)
 
 static const struct walk_method random_method =
 {
+	.name = "random",
 	.walk = random_walk,
 	.walk_start = random_start
 };
 
-static volatile int dont_optimize_me = 0;
+/* parameters of the MLP-controlled walks, see -W */
+static int walk_chains = 4;
+static size_t walk_stride = PAGE_SIZE;
+static int *cycle_order = NULL;
+/* position in the cycle (not in the arena) where the chains start */
+static size_t chains_pos;
 
-static void usage(char *error) {
-	fprintf(stderr, "Error: %s\n", error);
-	fprintf(stderr,
-		"Usage:\n"
-		"	rt_spin [COMMON-OPTS] WCET PERIOD DURATION\n"
-		"	rt_spin [COMMON-OPTS] -f FILE [-o COLUMN] WCET PERIOD\n"
-		"	rt_spin -l\n"
-		"\n"
-		"COMMON-OPTS = [-w] [-s SCALE]\n"
-		"              [-p PARTITION/CLUSTER [-z CLUSTER SIZE]] [-c CLASS] [-m CRITICALITY LEVEL]\n"
-		"              [-X LOCKING-PROTOCOL] [-L CRITICAL SECTION LENGTH] [-Q RESOURCE-ID]\n"
-		"              [-i [start,end]:[start,end]...]\n"
-		"\n"
-		"WCET and PERIOD are milliseconds, DURATION is seconds.\n"
-		"CRITICAL SECTION LENGTH is in milliseconds.\n");
-	exit(EXIT_FAILURE);
+static cacheline_t* chains_start(int wss)
+{
+	chains_pos = randrange(0, wss * CACHELINES_IN_1KB);
+	return arena + cycle_order[chains_pos];
 }
 
-/*
- * returns the character that made processing stop, newline or EOF
- */
-static int skip_to_next_line(FILE *fstream)
+static int chains_walk(cacheline_t *mem, int wss, int write_cycle)
 {
-	int ch;
-	for (ch = fgetc(fstream); ch != EOF && ch != '\n'; ch = fgetc(fstream));
-	return ch;
+	return chains_walk_lines(arena, cycle_order, wss * CACHELINES_IN_1KB,
+				 chains_pos, wss * CACHELINES_IN_1KB,
+				 walk_chains);
 }
 
-static void skip_comments(FILE *fstream)
+static const struct walk_method chains_method =
 {
-	int ch;
-	for (ch = fgetc(fstream); ch == '#'; ch = fgetc(fstream))
-		skip_to_next_line(fstream);
-	ungetc(ch, fstream);
-}
+	.name = "chains",
+	.walk = chains_walk,
+	.walk_start = chains_start
+};
 
-static void get_exec_times(const char *file, const int column,
-			   int *num_jobs,    double **exec_times)
+static int prefetch_walk(cacheline_t *mem, int wss, int write_cycle)
 {
-	FILE *fstream;
-	int  cur_job, cur_col, ch;
-	*num_jobs = 0;
+	return prefetch_walk_lines(mem, wss * CACHELINES_IN_1KB);
+}
 
-	fstream = fopen(file, "r");
-	if (!fstream)
-		bail_out("could not open execution time file");
+static const struct walk_method prefetch_method =
+{
+	.name = "prefetch",
+	.walk = prefetch_walk,
+	.walk_start = sequential_start
+};
 
-	/* figure out the number of jobs */
-	do {
-		skip_comments(fstream);
-		ch = skip_to_next_line(fstream);
-		if (ch != EOF)
-			++(*num_jobs);
-	} while (ch != EOF);
+static int stream_walk(cacheline_t *mem, int wss, int write_cycle)
+{
+	return stream_walk_lines(mem, wss * CACHELINES_IN_1KB, wss);
+}
 
-	if (-1 == fseek(fstream, 0L, SEEK_SET))
-		bail_out("rewinding file failed");
+static const struct walk_method stream_method =
+{
+	.name = "stream",
+	.walk = stream_walk,
+	.walk_start = sequential_start
+};
 
-	/* allocate space for exec times */
-	*exec_times = calloc(*num_jobs, sizeof(*exec_times));
-	if (!*exec_times)
-		bail_out("couldn't allocate memory");
+static int strided_walk(cacheline_t *mem, int wss, int write_cycle)
+{
+	return strided_walk_lines(mem, wss * CACHELINES_IN_1KB, walk_stride);
+}
 
-	for (cur_job = 0; cur_job < *num_jobs && !feof(fstream); ++cur_job) {
+static const struct walk_method strided_method =
+{
+	.name = "strided",
+	.walk = strided_walk,
+	.walk_start = sequential_start
+};
 
-		skip_comments(fstream);
+static const struct walk_method *walk_methods[] = {
+	&random_method, &sequential_method, &chains_method,
+	&prefetch_method, &stream_method, &strided_method,
+};
 
-		for (cur_col = 1; cur_col < column; ++cur_col) {
-			/* discard input until we get to the column we want */
-			int unused __attribute__ ((unused)) = fscanf(fstream, "%*s,");
+/* parse METHOD[:PARAM] as given to -W */
+static const struct walk_method* parse_walk_method(char *arg)
+{
+	char *param = strchr(arg, ':');
+	int i;
+
+	if (param)
+		*param++ = '\0';
+	for (i = 0; i < sizeof(walk_methods) / sizeof(walk_methods[0]); i++) {
+		if (strcmp(walk_methods[i]->name, arg))
+			continue;
+		if (param && walk_methods[i] == &chains_method) {
+			walk_chains = atoi(param);
+			if (walk_chains < 1 || walk_chains > MAX_WALK_CHAINS)
+				return NULL;
+		} else if (param && walk_methods[i] == &strided_method) {
+			walk_stride = atoi(param);
+			if (walk_stride < sizeof(cacheline_t) ||
+			    walk_stride % sizeof(cacheline_t))
+				return NULL;
 		}
+		return walk_methods[i];
+	}
+	return NULL;
+}
 
-		/* get the desired exec. time */
-		if (1 != fscanf(fstream, "%lf", (*exec_times)+cur_job)) {
-			fprintf(stderr, "invalid execution time near line %d\n",
-					cur_job);
-			exit(EXIT_FAILURE);
-		}
+static const struct walk_method *walk = &sequential_method;
+static struct walk_bw walk_bw;
 
-		skip_to_next_line(fstream);
-	}
+static volatile int dont_optimize_me = 0;
 
-	assert(cur_job == *num_jobs);
-	fclose(fstream);
+static void usage(char *error) {
+	fprintf(stderr, "Error: %s\n", error);
+	fprintf(stderr,
+		"Usage:\n"
+		"	rt_spin [COMMON-OPTS] WCET PERIOD DURATION\n"
+		"	rt_spin [COMMON-OPTS] -f FILE [-o COLUMN] WCET PERIOD\n"
+		"	rt_spin -l\n"
+		"\n"
+		"COMMON-OPTS = [-w] [-s SCALE]\n"
+		"              [-p PARTITION/CLUSTER [-z CLUSTER SIZE]] [-c CLASS] [-m CRITICALITY LEVEL]\n"
+		"              [-X LOCKING-PROTOCOL] [-L CRITICAL SECTION LENGTH] [-Q RESOURCE-ID]\n"
+		"              [-i [start,end]:[start,end]...]\n"
+		"              [-W WALK-METHOD[:PARAM]] [-A ARENA-FILE]\n"
+		"\n"
+		"WCET and PERIOD are milliseconds, DURATION is seconds.\n"
+		"CRITICAL SECTION LENGTH is in milliseconds.\n"
+		"WALK-METHOD is one of\n"
+		"  random       one pointer chain through the working set\n"
+		"  sequential   in-order reads and writes\n"
+		"  chains[:N]   N interleaved pointer chains (default 4, at most %d)\n"
+		"  prefetch     in-order reads with software prefetching\n"
+		"  stream       non-temporal stores\n"
+		"  strided[:B]  read-modify-write of lines B bytes apart (default %d)\n"
+		"-v reports the walk bandwidth of each job.\n"
+		"-A maps the arena from ARENA-FILE (e.g., on hugetlbfs), which is\n"
+		"   created on first use. It can be reused by any tool built with\n"
+		"   the same cache line size for the same working set size.\n",
+		MAX_WALK_CHAINS, PAGE_SIZE);
+	exit(EXIT_FAILURE);
 }
 
 static char* progname;
@@ -254,8 +298,16 @@ static int loop_once(int wss)
 	
 	//mem = random_method.walk_start(wss);
 	//temp = random_method.walk(mem, wss, 0);
-	mem = sequential_method.walk_start(wss);
-	temp = sequential_method.walk(mem, wss, 0);
+	mem = walk->walk_start(wss);
+	temp = walk->walk(mem, wss, 0);
+	if (walk == &chains_method)
+		/* each chain takes the same number of steps, the remainder
+		 * of the lines is not walked */
+		walk_bw.bytes += (size_t) (wss * CACHELINES_IN_1KB /
+					   walk_chains) * walk_chains *
+			sizeof(cacheline_t);
+	else
+		walk_bw.bytes += wss * 1024;
 	dont_optimize_me = temp;
 	
 	return dont_optimize_me;
@@ -263,19 +315,13 @@ static int loop_once(int wss)
 
 static int loop_for(int wss, double exec_time, double emergency_exit)
 {
-	double last_loop = 0, loop_start;
 	int tmp = 0;
 	int cur_loop = 0;
 
-	double start = cputime();
-	double now = cputime();
-
-	//while (now + last_loop < start + exec_time) {
-	while(cur_loop++ < loops) {
-		loop_start = now;
+	/* Fixed amount of work per job (see -l); exec_time is not used.
+	 * Only the wall clock is consulted, for the emergency exit. */
+	while (cur_loop++ < loops) {
 		tmp = loop_once(wss);
-		now = cputime();
-		last_loop = now - loop_start;
 		if (emergency_exit && wctime() > emergency_exit) {
 			/* Oops --- this should only be possible if the execution time tracking
 			 * is broken in the LITMUS^RT kernel. */
@@ -289,6 +335,28 @@ static int loop_for(int wss, double exec_time, double emergency_exit)
 }
 
 
+/* print per-job bandwidth, see -v */
+static int report_jobs = 0;
+
+static int walk_job_start(void *ctx, const struct litmus_job_info *info)
+{
+	if (report_jobs)
+		spin_job_print(ctx, info);
+	walk_bw_job_start(&walk_bw);
+	return 1;
+}
+
+static void walk_job_end(void *ctx, const struct litmus_job_info *info,
+			 lt_t completion)
+{
+	struct spin_job *sj = ctx;
+	double rate = walk_bw_job_end(&walk_bw);
+
+	if (report_jobs)
+		printf("%s/%d:%u walked %.1f MB/s\n", sj->name, gettid(),
+		       info->job_no, rate / 1E6);
+}
+
 static void debug_delay_loop(int wss)
 {
 	double start, end, delay;
@@ -307,47 +375,15 @@ static void debug_delay_loop(int wss)
 	}
 }
 
-static int job(int wss, double exec_time, double program_end, int lock_od, double cs_length)
-{
-	double chunk1, chunk2;
+/* working set size of the jobs, for spin_job() */
+static int job_wss;
 
-	if (wctime() > program_end)
-		return 0;
-	else {
-		if (lock_od >= 0) {
-			/* simulate critical section somewhere in the middle */
-			chunk1 = drand48() * (exec_time - cs_length);
-			chunk2 = exec_time - cs_length - chunk1;
-
-			/* non-critical section */
-			loop_for(wss, chunk1, program_end + 1);
-
-			/* critical section */
-			litmus_lock(lock_od);
-			loop_for(wss, cs_length, program_end + 1);
-			litmus_unlock(lock_od);
-
-			/* non-critical section */
-			loop_for(wss, chunk2, program_end + 2);
-		} else {
-			register unsigned long t;
-			register unsigned long overhead = get_cyclecount();
-			overhead = get_cyclecount() - overhead;
-			
-			//gettimeofday(&tm1, NULL);
-			t = get_cyclecount();
-			loop_for(wss, exec_time, program_end + 1);
-			t = get_cyclecount() - t;
-			printf("%ld cycles (%ld overhead))\n", t, overhead);
-			//gettimeofday(&tm2, NULL);
-			//printf("%ld\n", ((tm2.tv_sec * 1000000 + tm2.tv_usec) - (tm1.tv_sec * 1000000 + tm1.tv_usec)));
-		}
-		sleep_next_period();
-		return 1;
-	}
+static void loop_for_job(double exec_time, double emergency_exit)
+{
+	loop_for(job_wss, exec_time, emergency_exit);
 }
 
-#define OPTSTR "p:c:wl:veo:f:s:q:X:L:Q:vh:k:"
+#define OPTSTR "p:c:wl:veo:f:s:q:X:L:Q:vh:k:W:A:"
 int main(int argc, char** argv)
 {
 	int ret, i;
@@ -358,21 +394,22 @@ int main(int argc, char** argv)
 	int migrate = 0;
 	int cluster = 0;
 	int opt;
+	const char *arena_file = NULL;
 	int wait = 0;
 	int test_loop = 0;
 	int column = 1;
 	const char *file = NULL;
 	int want_enforcement = 0;
 	double duration = 0, start = 0;
-	double *exec_times = NULL;
+	struct exec_trace trace = {0};
 	double scale = 1.0;
 	task_class_t class = RT_CLASS_HARD;
-	int cur_job = 0, num_jobs = 0;
 	struct rt_task param;
 	int n_str, num_int = 0;
 	size_t arena_sz;
 	int verbose = 0;
-	unsigned int job_no;
+	struct spin_job sj = {0};
+	struct litmus_periodic_opts opts = {0};
 	int wss;
 
 	/* locking */
@@ -439,6 +476,14 @@ int main(int argc, char** argv)
 		case 'v':
 			verbose = 1;
 			break;
+		case 'W':
+			walk = parse_walk_method(optarg);
+			if (!walk)
+				usage("Unknown walk method.");
+			break;
+		case 'A':
+			arena_file = optarg;
+			break;
 		case ':':
 			usage("Argument missing.");
 			break;
@@ -457,15 +502,13 @@ int main(int argc, char** argv)
 	srand(getpid());
 
 	if (file) {
-		get_exec_times(file, column, &num_jobs, &exec_times);
+		load_exec_trace(&trace, file, column);
 
 		if (argc - optind < 2)
 			usage("Arguments missing.");
 
-		for (cur_job = 0; cur_job < num_jobs; ++cur_job) {
-			/* convert the execution time to seconds */
-			duration += exec_times[cur_job] * 0.001;
-		}
+		/* convert the execution time to seconds */
+		duration += trace.total * 0.001;
 	} else {
 		/*
 		 * if we're not reading from the CSV file, then we need
@@ -492,8 +535,8 @@ int main(int argc, char** argv)
 
 	if (!file)
 		duration  = atof(argv[optind + 2]);
-	else if (file && num_jobs > 1)
-		duration += period_ms * 0.001 * (num_jobs - 1);
+	else if (file && trace.num_jobs > 1)
+		duration += period_ms * 0.001 * (trace.num_jobs - 1);
 
 	if (migrate) {
 		ret = be_migrate_to_domain(cluster);
@@ -517,8 +560,16 @@ int main(int argc, char** argv)
 	
 	
 	arena_sz = wss*1024;
-	arena = alloc_arena(arena_sz, 0, 0);
-	init_arena(arena, arena_sz);
+	if (arena_file)
+		/* built once, shared with other users of the file */
+		arena = map_shared_arena(arena_file, arena_sz);
+	else {
+		arena = alloc_arena(arena_sz, 0, 0);
+		init_arena(arena, arena_sz);
+	}
+	if (walk == &chains_method)
+		cycle_order = arena_cycle_order(arena,
+						arena_sz / sizeof(cacheline_t));
 	
 	lock_memory();
 	
@@ -547,30 +598,37 @@ int main(int argc, char** argv)
 		start = wctime();
 	}
 
-	if (file) {
-		for (cur_job = 0; cur_job < num_jobs; ++cur_job) {
-			job(wss, exec_times[cur_job] * 0.001 * scale,
-			    start + duration,
-			    lock_od, cs_length * 0.001);
-		}
-	} else {
-		do {
-			if (verbose) {
-				get_job_no(&job_no);
-				printf("rtspin/%d:%u @ %.4fms\n", gettid(),
-					job_no, (wctime() - start) * 1000);
-			}
-		} while (job(wss, wcet_ms * 0.001 * scale, start + duration,
-			   lock_od, cs_length * 0.001));
-	}
+	job_wss = wss;
+	sj.loop_for = loop_for_job;
+	sj.name = "resspin";
+	sj.exec_times = trace.times;
+	sj.exec_time = wcet_ms * 0.001 * scale;
+	sj.scale = scale;
+	sj.start = start;
+	sj.program_end = start + duration;
+	sj.lock_od = lock_od;
+	sj.cs_length = cs_length * 0.001;
+
+	opts.duration = s2ns(duration);
+	if (file)
+		opts.max_jobs = trace.num_jobs;
+	report_jobs = verbose;
+	opts.pre_job = walk_job_start;
+	opts.post_job = walk_job_end;
+
+	if (litmus_run_periodic(spin_job, &sj, &opts) < 0)
+		bail_out("sleep_next_period()");
 
 	ret = task_mode(BACKGROUND_TASK);
 	if (ret != 0)
 		bail_out("could not become regular task (huh?)");
 
+	walk_bw_report(&walk_bw, "resspin");
+
 	if (file)
-		free(exec_times);
+		free_exec_trace(&trace);
 
 	dealloc_arena(arena, arena_sz);
+	free(cycle_order);
 	return 0;
 }
@@ -5,11 +5,13 @@
 #include <unistd.h>
 #include <time.h>
 #include <string.h>
-#include <assert.h>
 #include <limits.h>
+#include <errno.h>
+#include <pthread.h>
 
 #include "litmus.h"
 #include "common.h"
+#include "workloads.h"
 
 
 
@@ -19,172 +21,297 @@ static void usage(char *error) {
 		"Usage:\n"
 		"	rt_spin [COMMON-OPTS] WCET PERIOD DURATION\n"
 		"	rt_spin [COMMON-OPTS] -f FILE [-o COLUMN] WCET PERIOD\n"
+		"	rt_spin [COMMON-OPTS] -T TASKSET DURATION\n"
 		"	rt_spin -l\n"
 		"\n"
-		"COMMON-OPTS = [-w] [-s SCALE]\n"
+		"COMMON-OPTS = [-w] [-s SCALE] [-v] [-H] [-W WORKLOAD]\n"
 		"              [-p PARTITION/CLUSTER [-z CLUSTER SIZE]] [-c CLASS]\n"
 		"              [-X LOCKING-PROTOCOL] [-L CRITICAL SECTION LENGTH] [-Q RESOURCE-ID]"
 		"\n"
 		"WCET and PERIOD are milliseconds, DURATION is seconds.\n"
-		"CRITICAL SECTION LENGTH is in milliseconds.\n");
+		"CRITICAL SECTION LENGTH is in milliseconds.\n"
+		"-l (re)calibrates the spin loop and reports its accuracy.\n"
+		"-H reports job latency percentiles at exit.\n"
+		"-T spawns one spinning thread per line of TASKSET, each line being\n"
+		"   WCET PERIOD [PARTITION [PRIORITY [FILE [COLUMN]]]]\n"
+		"   where PARTITION -1 means no migration and FILE/COLUMN select\n"
+		"   per-job execution times as with -f/-o.\n"
+		"-W spins with one of the following kernels instead of an array walk:\n");
+	list_workloads(stderr);
 	exit(EXIT_FAILURE);
 }
 
-/*
- * returns the character that made processing stop, newline or EOF
- */
-static int skip_to_next_line(FILE *fstream)
+#define NUMS 4096
+static __thread int num[NUMS];
+static char* progname;
+
+static int loop_once(void)
 {
-	int ch;
-	for (ch = fgetc(fstream); ch != EOF && ch != '\n'; ch = fgetc(fstream));
-	return ch;
+	int i, j = 0;
+	for (i = 0; i < NUMS; i++)
+		j += num[i]++;
+	return j;
 }
 
-static void skip_comments(FILE *fstream)
+static __thread struct spin_loop spinner = {
+	.work = loop_once,
+	.name = "rtspin",
+};
+
+/* kernel selected with -W, if any */
+static const struct workload *workload;
+static char workload_loop_name[64];
+
+/* make the calling thread spin with the selected kernel */
+static int use_workload(void)
 {
-	int ch;
-	for (ch = fgetc(fstream); ch == '#'; ch = fgetc(fstream))
-		skip_to_next_line(fstream);
-	ungetc(ch, fstream);
+	if (!workload)
+		return 0;
+	if (workload->init() != 0)
+		return -1;
+	spinner.work = workload->work;
+	spinner.name = workload_loop_name;
+	return 0;
 }
 
-static void get_exec_times(const char *file, const int column,
-			   int *num_jobs,    double **exec_times)
+static void loop_for(double exec_time, double emergency_exit)
 {
-	FILE *fstream;
-	int  cur_job, cur_col, ch;
-	*num_jobs = 0;
-
-	fstream = fopen(file, "r");
-	if (!fstream)
-		bail_out("could not open execution time file");
-
-	/* figure out the number of jobs */
-	do {
-		skip_comments(fstream);
-		ch = skip_to_next_line(fstream);
-		if (ch != EOF)
-			++(*num_jobs);
-	} while (ch != EOF);
+	spin_for(&spinner, exec_time * 1E9, emergency_exit);
+}
 
-	if (-1 == fseek(fstream, 0L, SEEK_SET))
-		bail_out("rewinding file failed");
 
-	/* allocate space for exec times */
-	*exec_times = calloc(*num_jobs, sizeof(*exec_times));
-	if (!*exec_times)
-		bail_out("couldn't allocate memory");
+static void debug_delay_loop(void)
+{
+	spin_calibrate(&spinner, 1);
+	spin_report(&spinner);
+}
 
-	for (cur_job = 0; cur_job < *num_jobs && !feof(fstream); ++cur_job) {
+/* options shared by all tasks of a task set */
+struct taskset_opts {
+	double duration;
+	double scale;
+	int wait;
+	int verbose;
+	int histograms;
+	int protocol;
+	int resource_id;
+	const char *lock_namespace;
+	double cs_length;
+	/* spin loop calibration done by the main thread */
+	double ns_per_iter;
+};
+
+struct spin_task {
+	pthread_t thread;
+	struct litmus_admit_spec *spec;
+	const struct taskset_opts *common;
+	double wcet_ms;
+	double period_ms;
+	int partition;
+	unsigned int priority;
+	/* per-job execution times, if exec_times is set */
+	struct exec_trace trace;
+	int exec_times;
+	struct litmus_periodic_opts opts;
+	pthread_barrier_t *ready;
+	pthread_barrier_t *admitted;
+	int failed;
+};
+
+static void* spin_task_main(void *arg)
+{
+	struct spin_task *t = arg;
+	const struct taskset_opts *c = t->common;
+	struct spin_job sj = {0};
+	int lock_od = -1;
+	double start;
+	int no_workload;
+
+	no_workload = use_workload() != 0;
+	t->spec->tid = gettid();
+	pthread_barrier_wait(t->ready);
+	/* the main thread admits all tasks at once */
+	pthread_barrier_wait(t->admitted);
+	if (t->spec->status) {
+		errno = t->spec->status;
+		goto fail;
+	}
+	if (no_workload) {
+		errno = ENOMEM;
+		goto fail;
+	}
 
-		skip_comments(fstream);
+	spinner.ns_per_iter = c->ns_per_iter;
 
-		for (cur_col = 1; cur_col < column; ++cur_col) {
-			/* discard input until we get to the column we want */
-			int unused __attribute__ ((unused)) = fscanf(fstream, "%*s,");
-		}
+	if (init_rt_thread() != 0 || task_mode(LITMUS_RT_TASK) != 0)
+		goto fail;
 
-		/* get the desired exec. time */
-		if (1 != fscanf(fstream, "%lf", (*exec_times)+cur_job)) {
-			fprintf(stderr, "invalid execution time near line %d\n",
-					cur_job);
-			exit(EXIT_FAILURE);
-		}
+	if (c->histograms && litmus_stats_thread_init() != 0)
+		goto fail_rt;
 
-		skip_to_next_line(fstream);
+	if (c->protocol >= 0) {
+		lock_od = litmus_open_lock(c->protocol, c->resource_id,
+					   c->lock_namespace, &t->partition);
+		if (lock_od < 0)
+			goto fail_rt;
 	}
 
-	assert(cur_job == *num_jobs);
-	fclose(fstream);
-}
-
-#define NUMS 4096
-static int num[NUMS];
-static char* progname;
+	if (c->wait && wait_for_ts_release() != 0)
+		goto fail_rt;
+	start = wctime();
 
-static int loop_once(void)
-{
-	int i, j = 0;
-	for (i = 0; i < NUMS; i++)
-		j += num[i]++;
-	return j;
+	sj.loop_for = loop_for;
+	sj.name = "rtspin";
+	sj.exec_times = t->exec_times ? t->trace.times : NULL;
+	sj.exec_time = t->wcet_ms * 0.001 * c->scale;
+	sj.scale = c->scale;
+	sj.start = start;
+	sj.program_end = start + c->duration;
+	sj.lock_od = lock_od;
+	sj.cs_length = c->cs_length * 0.001;
+
+	t->opts.duration = s2ns(c->duration);
+	if (t->exec_times)
+		t->opts.max_jobs = t->trace.num_jobs;
+	if (c->verbose)
+		t->opts.pre_job = spin_job_print;
+
+	if (litmus_run_periodic(spin_job, &sj, &t->opts) < 0)
+		goto fail_rt;
+
+	task_mode(BACKGROUND_TASK);
+	if (c->verbose)
+		spin_print_stats(&spinner);
+	return NULL;
+
+fail_rt:
+	task_mode(BACKGROUND_TASK);
+fail:
+	fprintf(stderr, "rtspin: task %d: %s\n", t->spec->tid,
+		strerror(errno));
+	t->failed = 1;
+	return NULL;
 }
 
-static int loop_for(double exec_time, double emergency_exit)
+/* Parse a task set file; one task per line. */
+static int read_taskset(const char *file, struct spin_task **tasks)
 {
-	double last_loop = 0, loop_start;
-	int tmp = 0;
-
-	double start = cputime();
-	double now = cputime();
-
-	while (now + last_loop < start + exec_time) {
-		loop_start = now;
-		tmp += loop_once();
-		now = cputime();
-		last_loop = now - loop_start;
-		if (emergency_exit && wctime() > emergency_exit) {
-			/* Oops --- this should only be possible if the execution time tracking
-			 * is broken in the LITMUS^RT kernel. */
-			fprintf(stderr, "!!! rtspin/%d emergency exit!\n", getpid());
-			fprintf(stderr, "Something is seriously wrong! Do not ignore this.\n");
-			break;
+	FILE *fstream;
+	char line[512], exec_file[PATH_MAX];
+	struct spin_task *t;
+	int n = 0, size = 0, lineno = 0, fields, column;
+
+	fstream = fopen(file, "r");
+	if (!fstream)
+		bail_out("could not open task set file");
+
+	*tasks = NULL;
+	while (fgets(line, sizeof(line), fstream)) {
+		lineno++;
+		if (line[strspn(line, " \t\n")] == '#' ||
+		    !line[strspn(line, " \t\n")])
+			continue;
+
+		if (n == size) {
+			size = size ? size * 2 : 16;
+			*tasks = realloc(*tasks, size * sizeof(**tasks));
+			if (!*tasks)
+				bail_out("out of memory");
+		}
+		t = &(*tasks)[n];
+		memset(t, 0, sizeof(*t));
+		t->partition = -1;
+		t->priority = LITMUS_NO_PRIORITY;
+		column = 1;
+
+		fields = sscanf(line, "%lf %lf %d %u %4095s %d",
+				&t->wcet_ms, &t->period_ms, &t->partition,
+				&t->priority, exec_file, &column);
+		if (fields < 2 || t->wcet_ms <= 0 || t->period_ms <= 0 ||
+		    (fields < 5 && t->wcet_ms > t->period_ms) ||
+		    (fields >= 4 && !litmus_is_valid_fixed_prio(t->priority))) {
+			fprintf(stderr, "%s:%d: invalid task\n", file, lineno);
+			exit(EXIT_FAILURE);
 		}
+		if (fields >= 5) {
+			load_exec_trace(&t->trace, exec_file, column);
+			t->exec_times = 1;
+		}
+		n++;
 	}
+	fclose(fstream);
 
-	return tmp;
+	if (!n)
+		bail_out("empty task set");
+	return n;
 }
 
-
-static void debug_delay_loop(void)
+/* Run all tasks of a task set as threads of this process. */
+static int run_taskset(const char *file, const struct taskset_opts *common,
+		       task_class_t class, int want_enforcement)
 {
-	double start, end, delay;
-
-	while (1) {
-		for (delay = 0.5; delay > 0.01; delay -= 0.01) {
-			start = wctime();
-			loop_for(delay, 0);
-			end = wctime();
-			printf("%6.4fs: looped for %10.8fs, delta=%11.8fs, error=%7.4f%%\n",
-			       delay,
-			       end - start,
-			       end - start - delay,
-			       100 * (end - start - delay) / delay);
-		}
+	struct spin_task *tasks;
+	struct litmus_admit_spec *specs;
+	pthread_barrier_t ready, admitted;
+	unsigned long overruns = 0;
+	lt_t max_tardiness = 0;
+	int n, i, failed = 0;
+
+	n = read_taskset(file, &tasks);
+	specs = calloc(n, sizeof(*specs));
+	if (!specs)
+		bail_out("out of memory");
+
+	pthread_barrier_init(&ready, NULL, n + 1);
+	pthread_barrier_init(&admitted, NULL, n + 1);
+	for (i = 0; i < n; i++) {
+		init_rt_task_param(&specs[i].param);
+		specs[i].param.exec_cost = ms2ns(tasks[i].wcet_ms);
+		specs[i].param.period = ms2ns(tasks[i].period_ms);
+		specs[i].param.priority = tasks[i].priority;
+		specs[i].param.cls = class;
+		specs[i].param.budget_policy = (want_enforcement) ?
+			PRECISE_ENFORCEMENT : NO_ENFORCEMENT;
+		specs[i].domain = tasks[i].partition;
+
+		tasks[i].spec = &specs[i];
+		tasks[i].common = common;
+		tasks[i].ready = &ready;
+		tasks[i].admitted = &admitted;
+		if (pthread_create(&tasks[i].thread, NULL, spin_task_main,
+				   &tasks[i]))
+			bail_out("could not create task thread");
 	}
-}
 
-static int job(double exec_time, double program_end, int lock_od, double cs_length)
-{
-	double chunk1, chunk2;
-
-	if (wctime() > program_end)
-		return 0;
-	else {
-		if (lock_od >= 0) {
-			/* simulate critical section somewhere in the middle */
-			chunk1 = drand48() * (exec_time - cs_length);
-			chunk2 = exec_time - cs_length - chunk1;
-
-			/* non-critical section */
-			loop_for(chunk1, program_end + 1);
-
-			/* critical section */
-			litmus_lock(lock_od);
-			loop_for(cs_length, program_end + 1);
-			litmus_unlock(lock_od);
-
-			/* non-critical section */
-			loop_for(chunk2, program_end + 2);
-		} else {
-			loop_for(exec_time, program_end + 1);
-		}
-		sleep_next_period();
-		return 1;
+	/* all thread IDs are known once the threads reach the barrier */
+	pthread_barrier_wait(&ready);
+	litmus_admit_batch(specs, n, 0);
+	pthread_barrier_wait(&admitted);
+
+	for (i = 0; i < n; i++) {
+		pthread_join(tasks[i].thread, NULL);
+		failed |= tasks[i].failed;
+		overruns += tasks[i].opts.overruns;
+		if (tasks[i].opts.max_tardiness > max_tardiness)
+			max_tardiness = tasks[i].opts.max_tardiness;
+		if (tasks[i].exec_times)
+			free_exec_trace(&tasks[i].trace);
 	}
+	pthread_barrier_destroy(&ready);
+	pthread_barrier_destroy(&admitted);
+
+	if (common->verbose)
+		printf("deadline misses: %lu, max. tardiness: %.4fms\n",
+		       overruns, max_tardiness / 1E6);
+	if (common->histograms)
+		litmus_stats_dump(stdout);
+
+	free(specs);
+	free(tasks);
+	return failed;
 }
 
-#define OPTSTR "p:c:wlveo:f:s:q:r:X:L:Q:v"
+#define OPTSTR "p:c:wlveo:f:s:q:r:X:L:Q:vHT:W:"
 int main(int argc, char** argv)
 {
 	int ret;
@@ -200,16 +327,18 @@ int main(int argc, char** argv)
 	int test_loop = 0;
 	int column = 1;
 	const char *file = NULL;
+	const char *taskset = NULL;
 	int want_enforcement = 0;
 	double duration = 0, start = 0;
-	double *exec_times = NULL;
+	struct exec_trace trace = {0};
 	double scale = 1.0;
 	task_class_t class = RT_CLASS_HARD;
-	int cur_job = 0, num_jobs = 0;
 	struct rt_task param;
 
 	int verbose = 0;
-	unsigned int job_no;
+	int histograms = 0;
+	struct spin_job sj = {0};
+	struct litmus_periodic_opts opts = {0};
 
 	/* locking */
 	int lock_od = -1;
@@ -275,6 +404,20 @@ int main(int argc, char** argv)
 		case 'v':
 			verbose = 1;
 			break;
+		case 'H':
+			histograms = 1;
+			break;
+		case 'T':
+			taskset = optarg;
+			break;
+		case 'W':
+			workload = find_workload(optarg);
+			if (!workload)
+				usage("Unknown workload.");
+			/* each kernel has its own calibration */
+			snprintf(workload_loop_name, sizeof(workload_loop_name),
+				 "rtspin-%s", workload->name);
+			break;
 		case ':':
 			usage("Argument missing.");
 			break;
@@ -285,23 +428,49 @@ int main(int argc, char** argv)
 		}
 	}
 
+	if (use_workload() != 0)
+		bail_out("could not set up workload");
+
 	if (test_loop) {
 		debug_delay_loop();
 		return 0;
 	}
 
+	/* before we become a real-time task */
+	spin_calibrate(&spinner, 0);
+
 	srand(getpid());
 
+	if (taskset) {
+		struct taskset_opts common = {
+			.scale = scale,
+			.wait = wait,
+			.verbose = verbose,
+			.histograms = histograms,
+			.protocol = protocol,
+			.resource_id = resource_id,
+			.lock_namespace = lock_namespace,
+			.cs_length = cs_length,
+			.ns_per_iter = spinner.ns_per_iter,
+		};
+
+		if (argc - optind < 1)
+			usage("Arguments missing.");
+		common.duration = atof(argv[optind]);
+
+		if (init_litmus() != 0)
+			bail_out("init_litmus() failed");
+		return run_taskset(taskset, &common, class, want_enforcement);
+	}
+
 	if (file) {
-		get_exec_times(file, column, &num_jobs, &exec_times);
+		load_exec_trace(&trace, file, column);
 
 		if (argc - optind < 2)
 			usage("Arguments missing.");
 
-		for (cur_job = 0; cur_job < num_jobs; ++cur_job) {
-			/* convert the execution time to seconds */
-			duration += exec_times[cur_job] * 0.001;
-		}
+		/* convert the execution time to seconds */
+		duration += trace.total * 0.001;
 	} else {
 		/*
 		 * if we're not reading from the CSV file, then we need
@@ -328,8 +497,8 @@ int main(int argc, char** argv)
 
 	if (!file)
 		duration  = atof(argv[optind + 2]);
-	else if (file && num_jobs > 1)
-		duration += period_ms * 0.001 * (num_jobs - 1);
+	else if (file && trace.num_jobs > 1)
+		duration += period_ms * 0.001 * (trace.num_jobs - 1);
 
 	if (migrate) {
 		ret = be_migrate_to_domain(cluster);
@@ -361,6 +530,9 @@ int main(int argc, char** argv)
 	if (ret != 0)
 		bail_out("could not become RT task");
 
+	if (histograms && litmus_stats_thread_init() != 0)
+		bail_out("could not set up job statistics");
+
 	if (protocol >= 0) {
 		/* open reference to semaphore */
 		lock_od = litmus_open_lock(protocol, resource_id, lock_namespace, &cluster);
@@ -378,32 +550,41 @@ int main(int argc, char** argv)
 		start = wctime();
 	}
 
-	if (file) {
+	sj.loop_for = loop_for;
+	sj.name = "rtspin";
+	sj.exec_times = trace.times;
+	sj.exec_time = wcet_ms * 0.001 * scale;
+	sj.scale = scale;
+	sj.start = start;
+	sj.program_end = start + duration;
+	sj.lock_od = lock_od;
+	sj.cs_length = cs_length * 0.001;
+
+	opts.duration = s2ns(duration);
+	if (file)
 		/* use times read from the CSV file */
-		for (cur_job = 0; cur_job < num_jobs; ++cur_job) {
-			/* convert job's length to seconds */
-			job(exec_times[cur_job] * 0.001 * scale,
-			    start + duration,
-			    lock_od, cs_length * 0.001);
-		}
-	} else {
-		do {
-			if (verbose) {
-				get_job_no(&job_no);
-				printf("rtspin/%d:%u @ %.4fms\n", gettid(),
-					job_no, (wctime() - start) * 1000);
-			}
-			/* convert to seconds and scale */
-		} while (job(wcet_ms * 0.001 * scale, start + duration,
-			   lock_od, cs_length * 0.001));
-	}
+		opts.max_jobs = trace.num_jobs;
+	if (verbose)
+		opts.pre_job = spin_job_print;
+
+	if (litmus_run_periodic(spin_job, &sj, &opts) < 0)
+		bail_out("sleep_next_period()");
 
 	ret = task_mode(BACKGROUND_TASK);
 	if (ret != 0)
 		bail_out("could not become regular task (huh?)");
 
+	if (verbose) {
+		spin_print_stats(&spinner);
+		printf("deadline misses: %lu, max. tardiness: %.4fms\n",
+		       opts.overruns, opts.max_tardiness / 1E6);
+	}
+
+	if (histograms)
+		litmus_stats_dump(stdout);
+
 	if (file)
-		free(exec_times);
+		free_exec_trace(&trace);
 
 	return 0;
 }
@@ -0,0 +1,480 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#define WORKLOAD_X86
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define WORKLOAD_NEON
+#endif
+
+#include "workloads.h"
+
+/* All kernels work on fixed-size, per-thread buffers that are set up once by
+ * init(), so that work() neither allocates nor faults. Inputs are random but
+ * fixed, hence every call does the same amount of work. */
+
+static uint32_t next_rand(uint32_t *state)
+{
+	/* xorshift32 */
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+static float rand_float(uint32_t *state)
+{
+	/* in [-1, 1) */
+	return (next_rand(state) >> 8) / (float) (1 << 23) - 1.0f;
+}
+
+/* ----------------------------------------------------------------------------
+ * GEMM: C = A * B for 32x32 single-precision matrices
+ */
+
+#define GEMM_N 32
+
+struct gemm_state {
+	float a[GEMM_N * GEMM_N];
+	float b[GEMM_N * GEMM_N];
+	float c[GEMM_N * GEMM_N];
+} __attribute__((aligned(32)));
+
+static __thread struct gemm_state *gemm;
+static void (*gemm_kernel)(struct gemm_state *g);
+
+static void gemm_scalar(struct gemm_state *g)
+{
+	float aik;
+	int i, j, k;
+
+	for (i = 0; i < GEMM_N; i++)
+		for (k = 0; k < GEMM_N; k++) {
+			aik = g->a[i * GEMM_N + k];
+			for (j = 0; j < GEMM_N; j++)
+				g->c[i * GEMM_N + j] += aik * g->b[k * GEMM_N + j];
+		}
+}
+
+#ifdef WORKLOAD_X86
+__attribute__((target("avx2,fma")))
+static void gemm_avx(struct gemm_state *g)
+{
+	__m256 aik, c;
+	int i, j, k;
+
+	for (i = 0; i < GEMM_N; i++)
+		for (k = 0; k < GEMM_N; k++) {
+			aik = _mm256_set1_ps(g->a[i * GEMM_N + k]);
+			for (j = 0; j < GEMM_N; j += 8) {
+				c = _mm256_load_ps(&g->c[i * GEMM_N + j]);
+				c = _mm256_fmadd_ps(aik,
+					_mm256_load_ps(&g->b[k * GEMM_N + j]), c);
+				_mm256_store_ps(&g->c[i * GEMM_N + j], c);
+			}
+		}
+}
+
+__attribute__((target("sse2")))
+static void gemm_sse(struct gemm_state *g)
+{
+	__m128 aik, c;
+	int i, j, k;
+
+	for (i = 0; i < GEMM_N; i++)
+		for (k = 0; k < GEMM_N; k++) {
+			aik = _mm_set1_ps(g->a[i * GEMM_N + k]);
+			for (j = 0; j < GEMM_N; j += 4) {
+				c = _mm_load_ps(&g->c[i * GEMM_N + j]);
+				c = _mm_add_ps(c, _mm_mul_ps(aik,
+					_mm_load_ps(&g->b[k * GEMM_N + j])));
+				_mm_store_ps(&g->c[i * GEMM_N + j], c);
+			}
+		}
+}
+#endif
+
+#ifdef WORKLOAD_NEON
+static void gemm_neon(struct gemm_state *g)
+{
+	float aik;
+	float32x4_t c;
+	int i, j, k;
+
+	for (i = 0; i < GEMM_N; i++)
+		for (k = 0; k < GEMM_N; k++) {
+			aik = g->a[i * GEMM_N + k];
+			for (j = 0; j < GEMM_N; j += 4) {
+				c = vld1q_f32(&g->c[i * GEMM_N + j]);
+				c = vmlaq_n_f32(c,
+					vld1q_f32(&g->b[k * GEMM_N + j]), aik);
+				vst1q_f32(&g->c[i * GEMM_N + j], c);
+			}
+		}
+}
+#endif
+
+static int gemm_init(void)
+{
+	uint32_t seed = 1;
+	void *mem;
+	int i;
+
+	if (gemm)
+		return 0;
+	if (posix_memalign(&mem, 32, sizeof(*gemm)))
+		return -1;
+	gemm = mem;
+	for (i = 0; i < GEMM_N * GEMM_N; i++) {
+		gemm->a[i] = rand_float(&seed);
+		gemm->b[i] = rand_float(&seed);
+	}
+
+	/* use the widest vector unit available */
+	gemm_kernel = gemm_scalar;
+#if defined(WORKLOAD_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		gemm_kernel = gemm_avx;
+	else if (__builtin_cpu_supports("sse2"))
+		gemm_kernel = gemm_sse;
+#elif defined(WORKLOAD_NEON)
+	gemm_kernel = gemm_neon;
+#endif
+	return 0;
+}
+
+static int gemm_work(void)
+{
+	memset(gemm->c, 0, sizeof(gemm->c));
+	gemm_kernel(gemm);
+	return (int) gemm->c[0];
+}
+
+/* ----------------------------------------------------------------------------
+ * FIR filter: 64 taps over a block of 256 samples
+ */
+
+#define FIR_TAPS 64
+#define FIR_LEN  256
+
+struct fir_state {
+	float coef[FIR_TAPS];
+	float in[FIR_LEN + FIR_TAPS];
+	float out[FIR_LEN];
+};
+
+static __thread struct fir_state *fir;
+
+static int fir_init(void)
+{
+	uint32_t seed = 2;
+	int i;
+
+	if (fir)
+		return 0;
+	fir = malloc(sizeof(*fir));
+	if (!fir)
+		return -1;
+	for (i = 0; i < FIR_TAPS; i++)
+		fir->coef[i] = rand_float(&seed) / FIR_TAPS;
+	for (i = 0; i < FIR_LEN + FIR_TAPS; i++)
+		fir->in[i] = rand_float(&seed);
+	return 0;
+}
+
+static int fir_work(void)
+{
+	float acc;
+	int i, t;
+
+	for (i = 0; i < FIR_LEN; i++) {
+		acc = 0;
+		for (t = 0; t < FIR_TAPS; t++)
+			acc += fir->coef[t] * fir->in[i + t];
+		fir->out[i] = acc;
+	}
+	return (int) fir->out[FIR_LEN / 2];
+}
+
+/* ----------------------------------------------------------------------------
+ * FFT: iterative radix-2 transform of 256 complex doubles
+ */
+
+#define FFT_BITS 8
+#define FFT_N    (1 << FFT_BITS)
+
+struct fft_state {
+	double in_re[FFT_N], in_im[FFT_N];
+	double re[FFT_N], im[FFT_N];
+	double cos_t[FFT_N / 2], sin_t[FFT_N / 2];
+	uint16_t rev[FFT_N];
+};
+
+static __thread struct fft_state *fft;
+
+static int fft_init(void)
+{
+	uint32_t seed = 3;
+	int i, b;
+
+	if (fft)
+		return 0;
+	fft = malloc(sizeof(*fft));
+	if (!fft)
+		return -1;
+	for (i = 0; i < FFT_N; i++) {
+		fft->in_re[i] = rand_float(&seed);
+		fft->in_im[i] = rand_float(&seed);
+		fft->rev[i] = 0;
+		for (b = 0; b < FFT_BITS; b++)
+			if (i & (1 << b))
+				fft->rev[i] |= 1 << (FFT_BITS - 1 - b);
+	}
+	for (i = 0; i < FFT_N / 2; i++) {
+		fft->cos_t[i] = cos(2 * M_PI * i / FFT_N);
+		fft->sin_t[i] = sin(2 * M_PI * i / FFT_N);
+	}
+	return 0;
+}
+
+static int fft_work(void)
+{
+	double wr, wi, xr, xi;
+	int len, half, step, i, j, a, b;
+
+	/* the transform is done in place, start from the same input */
+	for (i = 0; i < FFT_N; i++) {
+		fft->re[fft->rev[i]] = fft->in_re[i];
+		fft->im[fft->rev[i]] = fft->in_im[i];
+	}
+
+	for (len = 2; len <= FFT_N; len <<= 1) {
+		half = len / 2;
+		step = FFT_N / len;
+		for (i = 0; i < FFT_N; i += len)
+			for (j = 0; j < half; j++) {
+				a = i + j;
+				b = a + half;
+				wr = fft->cos_t[j * step];
+				wi = -fft->sin_t[j * step];
+				xr = fft->re[b] * wr - fft->im[b] * wi;
+				xi = fft->re[b] * wi + fft->im[b] * wr;
+				fft->re[b] = fft->re[a] - xr;
+				fft->im[b] = fft->im[a] - xi;
+				fft->re[a] += xr;
+				fft->im[a] += xi;
+			}
+	}
+	return (int) fft->re[1];
+}
+
+/* ----------------------------------------------------------------------------
+ * Branchy state machine: a tokenizer over random input
+ */
+
+#define BRANCHY_INPUT (64 * 1024)
+#define BRANCHY_CHUNK 1024
+
+struct branchy_state {
+	unsigned char input[BRANCHY_INPUT];
+	unsigned int pos;
+};
+
+static __thread struct branchy_state *branchy;
+
+static int branchy_init(void)
+{
+	uint32_t seed = 4;
+	int i;
+
+	if (branchy)
+		return 0;
+	branchy = malloc(sizeof(*branchy));
+	if (!branchy)
+		return -1;
+	for (i = 0; i < BRANCHY_INPUT; i++)
+		branchy->input[i] = next_rand(&seed);
+	branchy->pos = 0;
+	return 0;
+}
+
+enum {
+	TOK_IDLE,
+	TOK_NUMBER,
+	TOK_WORD,
+	TOK_STRING,
+	TOK_ESCAPE,
+	TOK_COMMENT,
+};
+
+static int branchy_work(void)
+{
+	const unsigned char *in;
+	unsigned int number = 0, sum = 0, words = 0, strings = 0;
+	int state = TOK_IDLE, i;
+	unsigned char c;
+
+	/* walk a different part of the input each time, so that the branch
+	 * predictor cannot simply learn the sequence */
+	in = branchy->input + branchy->pos;
+	branchy->pos = (branchy->pos + BRANCHY_CHUNK) % BRANCHY_INPUT;
+
+	for (i = 0; i < BRANCHY_CHUNK; i++) {
+		c = in[i];
+		switch (state) {
+		case TOK_IDLE:
+			if (c < 40) {
+				state = TOK_NUMBER;
+				number = c % 10;
+			} else if (c < 140)
+				state = TOK_WORD;
+			else if (c < 160)
+				state = TOK_STRING;
+			else if (c < 170)
+				state = TOK_COMMENT;
+			break;
+		case TOK_NUMBER:
+			if (c < 150)
+				number = number * 10 + c % 10;
+			else {
+				sum += number;
+				state = TOK_IDLE;
+			}
+			break;
+		case TOK_WORD:
+			if (c >= 200) {
+				words++;
+				state = TOK_IDLE;
+			} else if (c < 10)
+				state = TOK_NUMBER;
+			break;
+		case TOK_STRING:
+			if (c == '\\' || c < 20)
+				state = TOK_ESCAPE;
+			else if (c >= 230) {
+				strings++;
+				state = TOK_IDLE;
+			}
+			break;
+		case TOK_ESCAPE:
+			state = TOK_STRING;
+			break;
+		case TOK_COMMENT:
+			if (c == '\n' || c >= 240)
+				state = TOK_IDLE;
+			break;
+		}
+	}
+	return sum + words + strings;
+}
+
+/* ----------------------------------------------------------------------------
+ * Tree lookup: random keys in an unbalanced binary search tree of 64k nodes
+ */
+
+#define TREE_NODES   65536
+#define TREE_LOOKUPS 32
+
+struct tree_node {
+	uint32_t key;
+	uint32_t val;
+	struct tree_node *child[2];
+};
+
+struct tree_state {
+	struct tree_node *nodes;
+	struct tree_node *root;
+	uint32_t seed;
+};
+
+static __thread struct tree_state *tree;
+
+static int tree_init(void)
+{
+	struct tree_node *node, **link;
+	int i;
+
+	if (tree)
+		return 0;
+	tree = calloc(1, sizeof(*tree));
+	if (!tree)
+		return -1;
+	tree->nodes = calloc(TREE_NODES, sizeof(*tree->nodes));
+	if (!tree->nodes) {
+		free(tree);
+		tree = NULL;
+		return -1;
+	}
+
+	/* random keys, so that neighbors in memory are not neighbors in
+	 * the tree */
+	tree->seed = 5;
+	for (i = 0; i < TREE_NODES; i++) {
+		node = &tree->nodes[i];
+		node->key = next_rand(&tree->seed);
+		node->val = i;
+		link = &tree->root;
+		while (*link)
+			link = &(*link)->child[node->key > (*link)->key];
+		*link = node;
+	}
+	return 0;
+}
+
+static int tree_work(void)
+{
+	const struct tree_node *node;
+	uint32_t key;
+	int i, found = 0;
+
+	for (i = 0; i < TREE_LOOKUPS; i++) {
+		key = next_rand(&tree->seed);
+		node = tree->root;
+		while (node && node->key != key)
+			node = node->child[key > node->key];
+		if (node)
+			found += node->val;
+	}
+	return found;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static const struct workload workloads[] = {
+	{"gemm", "32x32 float matrix multiply (AVX2/FMA, SSE2, NEON, or scalar)",
+	 gemm_init, gemm_work},
+	{"fir", "64-tap FIR filter over 256 float samples",
+	 fir_init, fir_work},
+	{"fft", "256-point complex double radix-2 FFT",
+	 fft_init, fft_work},
+	{"branchy", "tokenizer state machine over random input",
+	 branchy_init, branchy_work},
+	{"tree", "random lookups in a 64k-node binary search tree",
+	 tree_init, tree_work},
+};
+
+#define NUM_WORKLOADS (sizeof(workloads) / sizeof(workloads[0]))
+
+const struct workload* find_workload(const char *name)
+{
+	int i;
+
+	for (i = 0; i < NUM_WORKLOADS; i++)
+		if (!strcmp(workloads[i].name, name))
+			return &workloads[i];
+	return NULL;
+}
+
+void list_workloads(FILE *out)
+{
+	int i;
+
+	for (i = 0; i < NUM_WORKLOADS; i++)
+		fprintf(out, "  %-8s %s\n", workloads[i].name, workloads[i].desc);
+}
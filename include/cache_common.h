@@ -6,6 +6,7 @@
 #include <time.h>
 #include <string.h>
 #include <assert.h>
+#include <limits.h>
 
 #include <signal.h>
 #include <sys/mman.h>
@@ -18,6 +19,9 @@
 #include <sys/utsname.h>
 
 #include <sched.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/file.h>
 #include <sys/time.h>
 #include <sys/resource.h>
 
@@ -28,6 +32,10 @@
 #include "asm/irq.h"
 #endif
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 
 #define UNCACHE_DEV "/dev/litmus/uncache"
 
@@ -146,40 +154,445 @@ static void dealloc_arena(cacheline_t* arena, size_t size)
                 die("munmap() error");
 }
 
+/* xoshiro256** seeded with splitmix64: fast, and per thread, so that
+ * threads do not serialize on the lock inside rand(). */
+struct xoshiro {
+	uint64_t s[4];
+};
+
+static uint64_t splitmix64(uint64_t* x)
+{
+	uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+static void xoshiro_seed(struct xoshiro* rng, uint64_t seed)
+{
+	int i;
+	for (i = 0; i < 4; i++)
+		rng->s[i] = splitmix64(&seed);
+}
+
+static inline uint64_t xoshiro_next(struct xoshiro* rng)
+{
+	uint64_t* s = rng->s;
+	uint64_t x = s[1] * 5;
+	uint64_t result = ((x << 7) | (x >> 57)) * 9;
+	uint64_t t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = (s[3] << 45) | (s[3] >> 19);
+	return result;
+}
+
+/* uniform on [0, limit) for limit < 2^32, up to a bias of limit / 2^32 */
+static inline uint32_t xoshiro_below(struct xoshiro* rng, uint32_t limit)
+{
+	return ((xoshiro_next(rng) >> 32) * limit) >> 32;
+}
+
+static __thread struct xoshiro randrange_rng;
+static __thread int randrange_seeded;
+
 static int randrange(int min, int max)
 {
-        /* generate a random number on the range [min, max) w/o skew */
-        int limit = max - min;
-        int devisor = RAND_MAX/limit;
-        int retval;
+	/* generate a random number on the range [min, max) */
+	if (!randrange_seeded) {
+		xoshiro_seed(&randrange_rng, ((uint64_t) getpid() << 32) ^
+			     (uint64_t) gettid() ^ (uint64_t) time(NULL));
+		randrange_seeded = 1;
+	}
+	return min + xoshiro_below(&randrange_rng, max - min);
+}
 
-        do {
-                retval = rand() / devisor;
-        } while(retval == limit);
-        retval += min;
+/* Building the cycle: a uniformly random order of all cache lines is made by
+ * scattering the lines into random buckets, shuffling each bucket, and
+ * concatenating the buckets; linking each line to its successor in that
+ * order yields a single cycle through all of them. Every step is split
+ * among the builder threads. */
+
+#define ARENA_MAX_THREADS 16
+#define ARENA_BUCKETS_PER_THREAD 16
+/* below this many lines per thread, threads are not worth it */
+#define ARENA_LINES_PER_THREAD (64 * 1024)
+
+struct arena_builder {
+	cacheline_t* arena;
+	size_t num_lines;
+	int nthreads;
+	int nbuckets;
+	uint64_t seed;
+	uint8_t* bucket_of;
+	uint32_t* order;
+	/* start of each (bucket, thread) slot in order */
+	size_t offset[ARENA_MAX_THREADS * ARENA_BUCKETS_PER_THREAD]
+		[ARENA_MAX_THREADS];
+	size_t bucket_start[ARENA_MAX_THREADS * ARENA_BUCKETS_PER_THREAD + 1];
+	pthread_barrier_t barrier;
+};
+
+struct arena_worker {
+	struct arena_builder* b;
+	int id;
+	pthread_t thread;
+};
+
+static void* arena_worker_main(void* arg)
+{
+	struct arena_worker* w = arg;
+	struct arena_builder* b = w->b;
+	struct xoshiro rng;
+	size_t first = b->num_lines * w->id / b->nthreads;
+	size_t last = b->num_lines * (w->id + 1) / b->nthreads;
+	size_t count[ARENA_MAX_THREADS * ARENA_BUCKETS_PER_THREAD] = {0};
+	size_t i, j, n, next;
+	uint32_t tmp;
+	int k, bucket;
+
+	xoshiro_seed(&rng, b->seed + w->id);
+
+	/* 1: pick a bucket for each line of this thread's slice */
+	for (i = first; i < last; i++) {
+		b->bucket_of[i] = xoshiro_below(&rng, b->nbuckets);
+		count[b->bucket_of[i]]++;
+	}
+	for (bucket = 0; bucket < b->nbuckets; bucket++)
+		b->offset[bucket][w->id] = count[bucket];
+	pthread_barrier_wait(&b->barrier);
+
+	/* 2: thread 0 turns the counts into offsets, bucket-major */
+	if (w->id == 0) {
+		n = 0;
+		for (bucket = 0; bucket < b->nbuckets; bucket++) {
+			b->bucket_start[bucket] = n;
+			for (k = 0; k < b->nthreads; k++) {
+				i = b->offset[bucket][k];
+				b->offset[bucket][k] = n;
+				n += i;
+			}
+		}
+		b->bucket_start[b->nbuckets] = n;
+	}
+	pthread_barrier_wait(&b->barrier);
+
+	/* 3: scatter */
+	for (i = first; i < last; i++)
+		b->order[b->offset[b->bucket_of[i]][w->id]++] = i;
+	pthread_barrier_wait(&b->barrier);
+
+	/* 4: Fisher-Yates shuffle of this thread's buckets */
+	for (bucket = w->id; bucket < b->nbuckets; bucket += b->nthreads) {
+		uint32_t* o = b->order + b->bucket_start[bucket];
+		n = b->bucket_start[bucket + 1] - b->bucket_start[bucket];
+		for (i = n; i > 1; i--) {
+			j = xoshiro_below(&rng, i);
+			tmp = o[i - 1];
+			o[i - 1] = o[j];
+			o[j] = tmp;
+		}
+	}
+	pthread_barrier_wait(&b->barrier);
+
+	/* 5: link each line to its successor; every int in the cache line
+	 * points to the same cache line */
+	for (i = first; i < last; i++) {
+		next = b->order[(i + 1) % b->num_lines];
+		for (k = 0; k < INTS_IN_CACHELINE; k++)
+			b->arena[b->order[i]].line[k] = next;
+	}
+	return NULL;
+}
 
-        return retval;
+/* Generate a random cycle among the cache lines with several threads.
+ * Note: Sequential walk doesn't care about these values. */
+static void init_arena_parallel(cacheline_t* arena, size_t size, int nthreads)
+{
+	struct arena_builder* b;
+	struct arena_worker workers[ARENA_MAX_THREADS];
+	uint64_t seed = ((uint64_t) getpid() << 32) ^ (uint64_t) time(NULL);
+	int i;
+
+	b = calloc(1, sizeof(*b));
+	if (!b)
+		die("could not allocate arena builder");
+	b->arena = arena;
+	b->num_lines = size / sizeof(cacheline_t);
+	if (nthreads > ARENA_MAX_THREADS)
+		nthreads = ARENA_MAX_THREADS;
+	if (nthreads > b->num_lines / ARENA_LINES_PER_THREAD)
+		nthreads = b->num_lines / ARENA_LINES_PER_THREAD;
+	if (nthreads < 1)
+		nthreads = 1;
+	b->nthreads = nthreads;
+	b->nbuckets = nthreads * ARENA_BUCKETS_PER_THREAD;
+	b->seed = splitmix64(&seed);
+	b->bucket_of = malloc(b->num_lines);
+	b->order = malloc(b->num_lines * sizeof(*b->order));
+	if (!b->bucket_of || !b->order)
+		die("could not allocate arena builder");
+	pthread_barrier_init(&b->barrier, NULL, nthreads);
+
+	for (i = 0; i < nthreads; i++) {
+		workers[i].b = b;
+		workers[i].id = i;
+		if (i && pthread_create(&workers[i].thread, NULL,
+					arena_worker_main, &workers[i]))
+			die("could not start arena builder thread");
+	}
+	arena_worker_main(&workers[0]);
+	for (i = 1; i < nthreads; i++)
+		pthread_join(workers[i].thread, NULL);
+
+	pthread_barrier_destroy(&b->barrier);
+	free(b->bucket_of);
+	free(b->order);
+	free(b);
 }
 
 static void init_arena(cacheline_t* arena, size_t size)
 {
-    int i;
-        size_t num_arena_elem = size / sizeof(cacheline_t);
+	init_arena_parallel(arena, size, sysconf(_SC_NPROCESSORS_ONLN));
+}
 
-        /* Generate a cycle among the cache lines using Sattolo's algorithm.
-           Every int in the cache line points to the same cache line.
-           Note: Sequential walk doesn't care about these values. */
-        for (i = 0; i < num_arena_elem; i++) {
-                int j;
-                for(j = 0; j < INTS_IN_CACHELINE; ++j)
-                        arena[i].line[j] = i;
-        }
-        while(1 < i--) {
-                int j = randrange(0, i);
-                cacheline_t temp = arena[j];
-                arena[j] = arena[i];
-                arena[i] = temp;
-        }
+/* Arena files start with this header, padded to the size of a (huge) page
+ * so that the arena itself can be mapped at an aligned offset. The cycle
+ * stores line indices, so a file is only usable with the cache line size
+ * and number of lines it was built for. */
+#define ARENA_FILE_MAGIC 0x4172656e /* "Aren" */
+
+struct arena_file_header {
+	uint32_t magic;
+	uint32_t line_size;
+	uint64_t num_lines;
+};
+
+/* mmap() offsets into the file must be multiples of its page size, which
+ * is the huge page size on hugetlbfs */
+static inline off_t arena_file_header_size(int fd)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	struct stat st;
+
+	if (fstat(fd, &st) != 0)
+		die("could not stat arena file");
+	return st.st_blksize > page ? st.st_blksize : page;
+}
+
+/* Map an arena that was initialized once and stored in a file, e.g., on
+ * hugetlbfs, building (and storing) it first if the file does not exist
+ * yet. The mapping is private and populated up front, so each process still
+ * gets its own copy of the pages (walks that write do not disturb others),
+ * but copying them is much faster than building the cycle again. */
+static inline cacheline_t* map_shared_arena(const char* path, size_t size)
+{
+	char tmp_path[PATH_MAX];
+	struct arena_file_header* hdr;
+	cacheline_t* arena;
+	struct stat st;
+	off_t hdr_sz;
+	char* file;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		/* first user: build it under a temporary name, so that no
+		 * one maps a half-built arena */
+		snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+		fd = open(tmp_path, O_RDWR | O_CREAT, 0644);
+		if (fd < 0 || flock(fd, LOCK_EX) != 0)
+			die("could not create arena file");
+		if (access(path, F_OK) != 0) {
+			hdr_sz = arena_file_header_size(fd);
+			if (ftruncate(fd, hdr_sz + size) != 0)
+				die("could not size arena file");
+			/* hugetlbfs does not support write(), so fill in
+			 * the header through the mapping, too */
+			file = mmap(0, hdr_sz + size, PROT_READ | PROT_WRITE,
+				    MAP_SHARED, fd, 0);
+			if (file == MAP_FAILED)
+				die("could not map arena file");
+			init_arena((cacheline_t*) (file + hdr_sz), size);
+			hdr = (struct arena_file_header*) file;
+			hdr->magic = ARENA_FILE_MAGIC;
+			hdr->line_size = sizeof(cacheline_t);
+			hdr->num_lines = size / sizeof(cacheline_t);
+			munmap(file, hdr_sz + size);
+			if (rename(tmp_path, path) != 0)
+				die("could not rename arena file");
+		} else
+			/* someone else was faster */
+			unlink(tmp_path);
+		close(fd);
+		fd = open(path, O_RDONLY);
+	}
+	if (fd < 0 || fstat(fd, &st) != 0)
+		die("could not open arena file");
+	hdr_sz = arena_file_header_size(fd);
+	if (st.st_size != hdr_sz + size)
+		die("arena file has the wrong size");
+
+	hdr = mmap(0, hdr_sz, PROT_READ, MAP_SHARED, fd, 0);
+	if (hdr == MAP_FAILED)
+		die("could not map arena file");
+	if (hdr->magic != ARENA_FILE_MAGIC)
+		die("not an arena file");
+	if (hdr->line_size != sizeof(cacheline_t) ||
+	    hdr->num_lines != size / sizeof(cacheline_t))
+		die("arena file was built for a different cache line size");
+	munmap(hdr, hdr_sz);
+
+	arena = mmap(0, size, PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_POPULATE, fd, hdr_sz);
+	close(fd);
+	if (arena == MAP_FAILED)
+		die("could not map arena file");
+	return arena;
+}
+
+/* Walk kernels with a controlled degree of memory-level parallelism, from
+ * latency-bound (one pointer chain) to bandwidth-bound (streaming stores).
+ * Each touches every cache line of the given working set once. */
+
+#define MAX_WALK_CHAINS 32
+/* how far ahead prefetch_walk() prefetches, in cache lines */
+#define PREFETCH_DISTANCE 8
+
+/* The cache lines of the arena in the order of the cycle set up by
+ * init_arena(), so that chains_walk() can space its chains evenly. */
+static inline int* arena_cycle_order(cacheline_t* arena, size_t num_lines)
+{
+	int *order;
+	int i, next = 0;
+
+	order = malloc(num_lines * sizeof(*order));
+	if (!order)
+		die("could not allocate cycle order");
+	for (i = 0; i < num_lines; i++) {
+		order[i] = next;
+		next = arena[next].line[0];
+	}
+	return order;
+}
+
+/* Follow `chains` independent pointer chains for num_lines lines in total,
+ * starting at position `start` of the cycle of length cycle_len. The loads of
+ * different chains do not depend on each other, so up to `chains` misses are
+ * outstanding at any time. */
+static inline int chains_walk_lines(cacheline_t* arena, const int* order,
+			     size_t cycle_len, size_t start, int num_lines,
+			     int chains)
+{
+	int heads[MAX_WALK_CHAINS];
+	int steps = num_lines / chains, sum = 0, i, c;
+
+	for (c = 0; c < chains; c++)
+		heads[c] = order[(start + (size_t) c * steps) % cycle_len];
+	for (i = 0; i < steps; i++)
+		for (c = 0; c < chains; c++) {
+			heads[c] = arena[heads[c]].line[0];
+			sum += heads[c];
+		}
+	return sum;
+}
+
+/* Sequential read with software prefetching ahead of the reads */
+static inline int prefetch_walk_lines(cacheline_t* mem, int num_lines)
+{
+	int sum = 0, i, j;
+
+	for (i = 0; i < num_lines; i++) {
+		/* prefetches do not fault, even past the end */
+		__builtin_prefetch(&mem[i + PREFETCH_DISTANCE]);
+		for (j = 0; j < INTS_IN_CACHELINE; j++)
+			sum += mem[i].line[j];
+	}
+	return sum;
+}
+
+/* Overwrite every cache line without reading it first. Non-temporal stores
+ * bypass the cache where the architecture supports them (SSE2); elsewhere
+ * these are plain stores. */
+static inline int stream_walk_lines(cacheline_t* mem, int num_lines, int val)
+{
+	int i, j;
+#ifdef __SSE2__
+	__m128i v = _mm_set1_epi32(val);
+
+	for (i = 0; i < num_lines; i++)
+		for (j = 0; j < INTS_IN_CACHELINE; j += 4)
+			_mm_stream_si128((__m128i*) &mem[i].line[j], v);
+	/* order the weakly-ordered stores before whatever comes next */
+	_mm_sfence();
+#else
+	for (i = 0; i < num_lines; i++)
+		for (j = 0; j < INTS_IN_CACHELINE; j++)
+			((volatile cacheline_t*) mem)[i].line[j] = val;
+#endif
+	return val;
+}
+
+/* Increment one int per cache line, visiting the lines `stride` bytes apart
+ * (a multiple of the cache line size) in as many passes as needed to touch
+ * all of them. Large strides defeat the hardware prefetchers. */
+static inline int strided_walk_lines(cacheline_t* mem, int num_lines, size_t stride)
+{
+	size_t lines_per_stride = stride / sizeof(cacheline_t);
+	size_t off, pos;
+	int sum = 0;
+
+	if (!lines_per_stride)
+		lines_per_stride = 1;
+	for (off = 0; off < lines_per_stride; off++)
+		for (pos = off; pos < num_lines; pos += lines_per_stride)
+			sum += ++mem[pos].line[0];
+	return sum;
+}
+
+/* Achieved walk bandwidth per job */
+struct walk_bw {
+	unsigned long long bytes;	/* bytes walked so far */
+	unsigned long long job_bytes;	/* value of bytes at job start */
+	lt_t job_start;			/* CPU time at job start */
+	unsigned long jobs;
+	double sum, min, max;		/* bytes per second */
+};
+
+static inline void walk_bw_job_start(struct walk_bw* bw)
+{
+	bw->job_bytes = bw->bytes;
+	bw->job_start = litmus_cputime();
+}
+
+/* Returns the bandwidth of the job that just completed, in bytes/s. */
+static inline double walk_bw_job_end(struct walk_bw* bw)
+{
+	lt_t elapsed = litmus_cputime() - bw->job_start;
+	double rate;
+
+	if (!elapsed)
+		return 0;
+	rate = (bw->bytes - bw->job_bytes) / (elapsed / 1E9);
+	if (!bw->jobs || rate < bw->min)
+		bw->min = rate;
+	if (rate > bw->max)
+		bw->max = rate;
+	bw->sum += rate;
+	bw->jobs++;
+	return rate;
+}
+
+static inline void walk_bw_report(struct walk_bw* bw, const char* name)
+{
+	if (bw->jobs)
+		printf("%s/%d: %lu jobs, walked %.1f/%.1f/%.1f MB/s "
+		       "(min/mean/max)\n", name, getpid(), bw->jobs,
+		       bw->min / 1E6, bw->sum / bw->jobs / 1E6, bw->max / 1E6);
 }
 
 static void sleep_us(int microseconds)
@@ -210,4 +623,4 @@ inline unsigned long get_cyclecount (void)
 }
 
 
-#endif
\ No newline at end of file
+#endif
\ No newline at end of file
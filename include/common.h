@@ -6,10 +6,169 @@
 #ifndef COMMON_H
 #define COMMON_H
 
+#include "litmus.h"
+
 /**
  * End the current task with a message
  * @param msg Message to output before bailing
  */
 void bail_out(const char* msg);
 
+/**
+ * Unit of work repeated by a spin loop
+ */
+typedef int (*spin_work_t)(void);
+
+/**
+ * Calibrated busy loop
+ *
+ * The cost of one invocation of work() is measured once (or loaded from an
+ * on-disk cache) so that spinning for a given execution time only needs to
+ * consult the clock every few hundred microseconds, rather than after every
+ * invocation.
+ */
+struct spin_loop {
+	spin_work_t work;	/**< Unit of work */
+	const char *name;	/**< Key for the calibration cache file */
+	/** Workload parameters that the cost of work() depends on (e.g., the
+	 * working set size), also part of the cache key; may be NULL */
+	const char *params;
+	double ns_per_iter;	/**< Calibrated cost of one work() call */
+
+	/* accuracy statistics, updated by spin_for() */
+	unsigned long spins;	/**< Number of spin_for() calls */
+	double sum_err;		/**< Sum of relative errors */
+	double max_err;		/**< Largest relative error (absolute value) */
+};
+
+/**
+ * Determine the cost of one iteration of a spin loop
+ * @param sl Spin loop to calibrate
+ * @param force Ignore (and overwrite) a cached calibration result
+ */
+void spin_calibrate(struct spin_loop *sl, int force);
+
+/**
+ * Burn a given amount of CPU time
+ * @param sl Calibrated spin loop
+ * @param exec_ns CPU time to consume, in nanoseconds
+ * @param emergency_exit Wall-clock time (see wctime()) at which to give up,
+ * 0 for none
+ * @return Amount of CPU time actually consumed, in nanoseconds
+ */
+lt_t spin_for(struct spin_loop *sl, lt_t exec_ns, double emergency_exit);
+
+/**
+ * Print requested vs. achieved execution times for a range of lengths
+ * @param sl Calibrated spin loop
+ */
+void spin_report(struct spin_loop *sl);
+
+/**
+ * Print the accuracy statistics gathered by spin_for()
+ * @param sl Spin loop
+ */
+void spin_print_stats(struct spin_loop *sl);
+
+/**
+ * Magic number of binary execution-time files ("LTXE")
+ */
+#define EXEC_TRACE_MAGIC 0x4558544c
+
+/**
+ * Header of a binary execution-time file
+ *
+ * The header is followed by num_jobs doubles in host byte order, so that the
+ * file can be mapped and used in place.
+ */
+struct exec_trace_header {
+	uint32_t magic;		/**< EXEC_TRACE_MAGIC */
+	uint32_t reserved;	/**< Zero */
+	uint64_t num_jobs;	/**< Number of execution times that follow */
+	double total;		/**< Sum of all execution times, in ms */
+};
+
+/**
+ * Per-job execution times of a replayed workload
+ */
+struct exec_trace {
+	const double *times;	/**< Execution time of each job, in ms */
+	unsigned long num_jobs;	/**< Number of entries in times */
+	double total;		/**< Sum of all execution times, in ms */
+
+	/* private */
+	void *map;
+	size_t map_len;
+	double *parsed;
+};
+
+/**
+ * Load per-job execution times, bailing out on error
+ * @param trace Trace to initialize
+ * @param file Binary execution-time file or text file with one job per line
+ * @param column Column (starting at 1) of the execution times in a text
+ * file; columns are separated by whitespace and/or commas, lines starting
+ * with '#' are ignored
+ *
+ * Binary files are mapped rather than read, so that jobs are paged in as they
+ * are replayed.
+ */
+void load_exec_trace(struct exec_trace *trace, const char *file, int column);
+
+/**
+ * Write execution times in the binary format understood by load_exec_trace()
+ * @param trace Loaded trace
+ * @param file File to create
+ * @return 0 on success, -1 on error
+ */
+int write_exec_trace(const struct exec_trace *trace, const char *file);
+
+/**
+ * Release a trace loaded with load_exec_trace()
+ * @param trace Trace to release
+ */
+void free_exec_trace(struct exec_trace *trace);
+
+/**
+ * Job of the spinning tools, for use with litmus_run_periodic()
+ *
+ * Each job spins for its execution time, optionally with a critical section
+ * of length cs_length at a random point in the middle.
+ */
+struct spin_job {
+	/** Spin for exec_time seconds, giving up at emergency_exit */
+	void (*loop_for)(double exec_time, double emergency_exit);
+	/** Per-job execution times in milliseconds (e.g., from a file), or
+	 * NULL to use exec_time for every job */
+	const double *exec_times;
+	/** Index of the next entry in exec_times */
+	int cur_job;
+	/** Execution time of every job in seconds, unless exec_times is set */
+	double exec_time;
+	/** Factor applied to exec_times */
+	double scale;
+	/** Start of the run, see wctime() */
+	double start;
+	/** Emergency exit for loop_for(), see wctime() */
+	double program_end;
+	/** Lock to take in the critical section, or -1 */
+	int lock_od;
+	/** Length of the critical section in seconds */
+	double cs_length;
+	/** Prefix of the per-job output of spin_job_print() */
+	const char *name;
+};
+
+/**
+ * Run one job of a struct spin_job, see litmus_job_fn
+ */
+int spin_job(void *ctx, const struct litmus_job_info *info);
+
+/**
+ * Print the number and start time of a job of a struct spin_job
+ *
+ * Meant as the pre_job hook of litmus_run_periodic().
+ */
+int spin_job_print(void *ctx, const struct litmus_job_info *info);
+
 #endif
@@ -0,0 +1,304 @@
+/**
+ * @file fastpath.h
+ * Header-inline fast paths for the LITMUS^RT calls made once or more per job
+ *
+ * Include this header (in addition to litmus.h) to issue the per-job system
+ * calls directly from the calling function, without going through liblitmus
+ * and glibc's variadic syscall() wrapper. On architectures without inline
+ * system call support, the functions below fall back to syscall().
+ */
+
+#ifndef FASTPATH_H
+#define FASTPATH_H
+
+#include <errno.h>
+#include <unistd.h> /* for syscall() */
+
+#include "litmus.h"
+
+/* imported from the kernel source tree */
+#include "asm/unistd.h"
+
+#include "asm/inline_syscall.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef ARCH_HAS_INLINE_SYSCALL
+
+/**
+ * @private
+ * Map a raw kernel return value to the libc convention (-1 and errno)
+ */
+static inline long __litmus_syscall_ret(long ret)
+{
+	if ((unsigned long) ret > -4096UL) {
+		errno = -ret;
+		return -1;
+	}
+	return ret;
+}
+
+/**
+ * @private
+ * Issue a system call without arguments
+ */
+#define litmus_syscall0(nr) \
+	__litmus_syscall_ret(arch_syscall0(nr))
+/**
+ * @private
+ * Issue a system call with one argument
+ */
+#define litmus_syscall1(nr, arg1) \
+	__litmus_syscall_ret(arch_syscall1(nr, (long) (arg1)))
+
+#else
+
+#define litmus_syscall0(nr)       syscall(nr)
+#define litmus_syscall1(nr, arg1) syscall(nr, arg1)
+
+#endif
+
+/**
+ * Inline variant of sleep_next_period()
+ * @return 0 on success
+ */
+static inline int sleep_next_period_fast(void)
+{
+	int ret;
+
+	litmus_trace(LITMUS_EV_SLEEP_NEXT_PERIOD, 0);
+	ret = litmus_syscall0(__NR_complete_job);
+	litmus_trace(LITMUS_EV_SLEEP_NEXT_PERIOD_DONE, 0);
+	return ret;
+}
+
+/**
+ * Inline variant of litmus_lock()
+ * @param od Object descriptor obtained by litmus_open_lock()
+ * @return 0 iff the lock was acquired successfully
+ */
+static inline int litmus_lock_fast(int od)
+{
+	int ret;
+
+	litmus_trace(LITMUS_EV_LOCK_REQUEST, od);
+	ret = litmus_syscall1(__NR_litmus_lock, od);
+	litmus_trace(LITMUS_EV_LOCK_ACQUIRED, od);
+	return ret;
+}
+
+/**
+ * Inline variant of litmus_unlock()
+ * @param od Object descriptor obtained by litmus_open_lock()
+ * @return 0 iff the lock was released successfully
+ */
+static inline int litmus_unlock_fast(int od)
+{
+	int ret;
+
+	litmus_trace(LITMUS_EV_LOCK_RELEASE, od);
+	ret = litmus_syscall1(__NR_litmus_unlock, od);
+	litmus_trace(LITMUS_EV_LOCK_RELEASED, od);
+	return ret;
+}
+
+/**
+ * Inline variant of null_call()
+ * @param timestamp Cycle count recorded by the kernel upon entry
+ * @return 0 on success
+ */
+static inline int null_call_fast(cycles_t *timestamp)
+{
+	return litmus_syscall1(__NR_null_call, timestamp);
+}
+
+/**
+ * @private
+ * Control page of the calling thread, mapped by init_rt_thread()
+ */
+extern __thread struct control_page *__litmus_ctrl_page;
+/**
+ * @private
+ * Non-preemptive section statistics of the calling thread
+ */
+extern __thread struct np_stats __litmus_np_stats;
+
+/**
+ * @private
+ * Keep the compiler from moving memory accesses across NP section bounds
+ */
+#define __np_barrier() __asm__ __volatile__("" : : : "memory")
+
+/**
+ * Inline variant of enter_np()
+ *
+ * Unlike enter_np(), this does not map the control page on demand: the
+ * calling thread must have been set up with init_rt_thread() (or
+ * init_litmus()) before. Sections may be nested.
+ */
+static inline void enter_np_fast(void)
+{
+	struct control_page *cp = __litmus_ctrl_page;
+	uint32_t nesting = cp->sched.np.flag;
+
+#ifdef LITMUS_NP_STATS
+	if (!nesting)
+		__litmus_np_stats.start = get_cycles();
+#endif
+	/* test the trace flag first, so that the probe is a single branch
+	 * while tracing is inactive */
+	if (__builtin_expect(__litmus_trace_enabled, 0) && !nesting)
+		__litmus_trace_record(LITMUS_EV_NP_ENTER, 0);
+	cp->sched.np.flag = nesting + 1;
+	__np_barrier();
+}
+
+/**
+ * Inline variant of exit_np()
+ *
+ * Leaving the outermost section yields the processor if the kernel
+ * requested a preemption in the meantime. Same precondition as
+ * enter_np_fast().
+ */
+static inline void exit_np_fast(void)
+{
+	struct control_page *cp = __litmus_ctrl_page;
+
+	__np_barrier();
+	if (cp->sched.np.flag && !(--cp->sched.np.flag)) {
+#ifdef LITMUS_NP_STATS
+		cycles_t len = get_cycles() - __litmus_np_stats.start;
+		__litmus_np_stats.sections++;
+		if (len > __litmus_np_stats.longest)
+			__litmus_np_stats.longest = len;
+#endif
+		litmus_trace(LITMUS_EV_NP_EXIT, 0);
+		/* became preemptive, let's check for delayed preemptions */
+		__sync_synchronize();
+		if (cp->sched.np.preempt) {
+#ifdef LITMUS_NP_STATS
+			__litmus_np_stats.preempted++;
+#endif
+			litmus_syscall0(__NR_sched_yield);
+		}
+	}
+}
+
+/**
+ * @private
+ * Tell the processor that we are busy-waiting
+ */
+#if defined(__i386__) || defined(__x86_64__)
+#define __np_cpu_relax() __asm__ __volatile__("pause" : : : "memory")
+#else
+#define __np_cpu_relax() __np_barrier()
+#endif
+
+/**
+ * @private
+ * Take a ticket and spin until it is served
+ */
+static inline void __np_spin_acquire(struct np_spinlock *lock)
+{
+	uint32_t ticket = __sync_fetch_and_add(&lock->next, 1);
+
+	while (lock->owner != ticket)
+		__np_cpu_relax();
+	/* keep the critical section after the acquisition */
+	__sync_synchronize();
+}
+
+/**
+ * @private
+ * Take a ticket only if it would be served immediately
+ */
+static inline int __np_spin_tryacquire(struct np_spinlock *lock)
+{
+	uint32_t ticket = lock->owner;
+
+	return lock->next == ticket &&
+		__sync_bool_compare_and_swap(&lock->next, ticket, ticket + 1);
+}
+
+/**
+ * @private
+ * Hand the lock to the next ticket
+ */
+static inline void __np_spin_release(struct np_spinlock *lock)
+{
+	/* make the critical section visible before handing over */
+	__sync_synchronize();
+	lock->owner++;
+}
+
+/**
+ * Inline variant of np_spin_lock()
+ * @param lock Lock to acquire
+ *
+ * Same precondition as enter_np_fast().
+ */
+static inline void np_spin_lock_fast(struct np_spinlock *lock)
+{
+	enter_np_fast();
+	__np_spin_acquire(lock);
+}
+
+/**
+ * Inline variant of np_spin_trylock()
+ * @param lock Lock to acquire
+ * @return 1 iff the lock was acquired
+ */
+static inline int np_spin_trylock_fast(struct np_spinlock *lock)
+{
+	enter_np_fast();
+	if (__np_spin_tryacquire(lock))
+		return 1;
+	exit_np_fast();
+	return 0;
+}
+
+/**
+ * Inline variant of np_spin_unlock()
+ * @param lock Lock to release
+ */
+static inline void np_spin_unlock_fast(struct np_spinlock *lock)
+{
+	__np_spin_release(lock);
+	exit_np_fast();
+}
+
+/**
+ * @private
+ * Cleanup handler of NP_SCOPE()
+ */
+static inline void __np_scope_exit(int *unused)
+{
+	(void) unused;
+	exit_np_fast();
+}
+
+#define __NP_SCOPE_VAR2(line) __np_scope_ ## line
+#define __NP_SCOPE_VAR(line)  __NP_SCOPE_VAR2(line)
+
+/**
+ * Make the rest of the enclosing block non-preemptive
+ *
+ * Calls enter_np_fast() and arranges for exit_np_fast() to be called when
+ * the block is left, including via return, break, or goto:
+ *
+ *     {
+ *             NP_SCOPE();
+ *             ... critical section ...
+ *     }
+ */
+#define NP_SCOPE() \
+	int __NP_SCOPE_VAR(__LINE__) \
+		__attribute__((cleanup(__np_scope_exit), unused)) = \
+		(enter_np_fast(), 0)
+
+#ifdef __cplusplus
+}
+#endif
+#endif
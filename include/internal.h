@@ -26,5 +26,10 @@
 /* I/O convenience function */
 ssize_t read_file(const char* fname, void* buf, size_t maxlen);
 
+/* job statistics of the calling thread, NULL if not enabled */
+struct thread_stats;
+extern __thread struct thread_stats *__litmus_stats;
+int stats_sleep_next_period(void);
+
 #endif
 
@@ -29,6 +29,7 @@ extern "C" {
 
 #include <sys/types.h>
 #include <stdint.h>
+#include <stdio.h>
 
 /* Include kernel header.
  * This is required for the rt_param
@@ -210,6 +211,64 @@ static inline int od_open(int fd, obj_type_t type, int obj_id)
 int litmus_open_lock(obj_type_t protocol, int lock_id, const char* name_space,
 		void *config_param);
 
+/**
+ * Open a lock namespace for repeated use
+ *
+ * Opening many locks with litmus_open_lock() opens and closes the namespace
+ * file for each of them. Keep the returned handle instead and use
+ * litmus_open_lock_ns() or litmus_open_locks().
+ * @param name_space Path to a shared file, created if necessary
+ * @return Namespace handle (a file descriptor), or -1 on error
+ */
+int litmus_open_namespace(const char* name_space);
+/**
+ * Close a namespace handle; locks opened through it remain open
+ * @param ns Handle obtained by litmus_open_namespace()
+ * @return 0 on success
+ */
+int litmus_close_namespace(int ns);
+/**
+ * Open a lock in an already opened namespace
+ * @param ns Handle obtained by litmus_open_namespace()
+ * @param protocol Desired locking protocol
+ * @param lock_id Name of the lock, user-specified numerical id
+ * @param config_param Any extra info needed by the protocol, may be NULL
+ * @return Object descriptor for this lock
+ */
+int litmus_open_lock_ns(int ns, obj_type_t protocol, int lock_id,
+		void *config_param);
+
+/** One lock to be opened by litmus_open_locks() */
+struct litmus_lock_spec {
+	/** Desired locking protocol */
+	obj_type_t protocol;
+	/** Name of the lock, user-specified numerical id */
+	int lock_id;
+	/** Any extra info needed by the protocol, may be NULL */
+	void *config_param;
+	/** Set to the object descriptor of the opened lock */
+	int od;
+};
+
+/**
+ * Open a batch of locks in one namespace
+ *
+ * Either all locks are opened or none: if one of them cannot be opened,
+ * the ones opened before it are closed again.
+ * @param ns Handle obtained by litmus_open_namespace()
+ * @param specs Locks to open; the od field of each entry is filled in
+ * @param num Number of entries in specs
+ * @return 0 on success, -1 on error (with errno set by the failing open)
+ */
+int litmus_open_locks(int ns, struct litmus_lock_spec *specs, int num);
+/**
+ * Close a batch of locks opened by litmus_open_locks()
+ * @param specs Locks to close; the od field of each entry is reset to -1
+ * @param num Number of entries in specs
+ * @return 0 if all locks were closed, -1 otherwise
+ */
+int litmus_close_locks(struct litmus_lock_spec *specs, int num);
+
 /**
  * Obtain lock
  * @param od Object descriptor obtained by litmus_open_lock()
@@ -225,11 +284,39 @@ int litmus_unlock(int od);
 
 /***** job control *****/
 /**
- * @todo Doxygen
+ * Parameters of the current job as exposed by the kernel
+ */
+struct litmus_job_info {
+	unsigned int job_no;	/**< Sequence number of the current job */
+	lt_t release;		/**< Release time of the current job */
+	lt_t deadline;		/**< Absolute deadline of the current job */
+};
+
+/**
+ * Obtain the sequence number of the current job
+ * @param job_no Pointer to store the job number in
+ * @return 0 on success
+ *
+ * Read from the control page if possible, otherwise a system call is made.
  */
 int get_job_no(unsigned int* job_no);
 /**
- * @todo Doxygen
+ * Obtain number, release time, and deadline of the current job
+ * @param info Struct to fill
+ * @return 0 on success
+ *
+ * Does not enter the kernel if the control page of the calling thread is
+ * mapped. If the kernel does not expose job parameters in the control page,
+ * only job_no is filled in (by means of a system call).
+ */
+int get_job_info(struct litmus_job_info *info);
+/**
+ * Wait until the job with the given sequence number has been released
+ * @param job_no Sequence number of the job to wait for
+ * @return 0 on success
+ *
+ * Returns immediately, without a system call, if the control page shows that
+ * the job has already been released.
  */
 int wait_for_job_release(unsigned int job_no);
 /**
@@ -238,6 +325,63 @@ int wait_for_job_release(unsigned int job_no);
  */
 int sleep_next_period(void);
 
+/**
+ * Job body for litmus_run_periodic()
+ * @param ctx Context pointer passed to litmus_run_periodic()
+ * @param job Number, release, and deadline of the job
+ * @return Nonzero to continue with the next job, 0 to stop after this one
+ */
+typedef int (*litmus_job_fn)(void *ctx, const struct litmus_job_info *job);
+
+/**
+ * Options and results of litmus_run_periodic()
+ *
+ * Zero-initialize and set the fields of interest; all inputs are optional.
+ */
+struct litmus_periodic_opts {
+	/** Stop once this much time has passed since the start, 0 for no
+	 * limit; the job running at that time is completed */
+	lt_t duration;
+	/** Stop after this many jobs, 0 for no limit */
+	unsigned long max_jobs;
+	/** Called before each job; return 0 to stop without running it */
+	litmus_job_fn pre_job;
+	/** Called after each job, before sleep_next_period() */
+	void (*post_job)(void *ctx, const struct litmus_job_info *job,
+			 lt_t completion);
+	/** Called after each job that completed after its deadline */
+	void (*overrun)(void *ctx, const struct litmus_job_info *job,
+			lt_t completion);
+
+	/** Result: number of jobs that missed their deadline */
+	unsigned long overruns;
+	/** Result: largest tardiness of any job */
+	lt_t max_tardiness;
+};
+
+/**
+ * Run a periodic (or sporadic) job loop
+ * @param job_fn Job body, called once per job
+ * @param ctx Context pointer passed to job_fn and all hooks
+ * @param opts Termination conditions, hooks, and results; may be NULL
+ * @return Number of completed jobs, or -1 if sleep_next_period() failed
+ *
+ * The calling thread must already be a real-time task. The first job runs
+ * right away: it is the job that is current when the function is called
+ * (e.g., the first job after wait_for_ts_release()). Callers that used to
+ * call sleep_next_period() before each job must do so once before calling
+ * this function to keep that behavior. Every job, including the last one,
+ * is completed with sleep_next_period(), so the function returns only after
+ * the next job has been released. The job boundary is
+ * read once per job with get_job_info() and the clock once after each job.
+ * Jobs are marked in the event trace (LITMUS_EV_JOB_START/END) and, via
+ * sleep_next_period(), counted in the job statistics. If the kernel does
+ * not expose job parameters in the control page, releases are approximated
+ * by the wake-up times and deadlines derived from the task parameters.
+ */
+long litmus_run_periodic(litmus_job_fn job_fn, void *ctx,
+			 struct litmus_periodic_opts *opts);
+
 /**
  * Initialises real-time properties for the entire program
  * @return 0 on success
@@ -265,6 +409,38 @@ enum rt_task_mode_t {
  */
 int task_mode(int target_mode);
 
+/**
+ * Per-thread specification for litmus_admit_batch()
+ */
+struct litmus_admit_spec {
+	pid_t tid;		/**< Thread to admit */
+	struct rt_task param;	/**< Real-time parameters of the thread */
+	int domain;		/**< Cluster/partition to migrate to,
+				     -1 for none (global scheduling) */
+	int status;		/**< Output: 0 on success, otherwise the errno
+				     value of the failed step */
+};
+
+/** litmus_admit_batch() flag: also transition the threads to SCHED_LITMUS */
+#define LITMUS_ADMIT_RT_MODE 0x1
+
+/**
+ * Set up many (best-effort) threads as real-time tasks at once
+ * @param specs Array of per-thread specifications
+ * @param num Number of entries in specs
+ * @param flags LITMUS_ADMIT_RT_MODE or 0
+ * @return Number of successfully admitted threads, or -1 on error
+ *
+ * For each entry, migrates the thread to its domain (setting param.cpu to
+ * the domain's first CPU), sets its real-time parameters, and, if requested,
+ * makes it a real-time task. The work is spread across worker threads
+ * pinned to the target domains. The outcome for each entry is reported in
+ * its status field; entries with a tid <= 0 (the caller cannot be admitted
+ * this way) or an unknown domain fail with EINVAL. Each admitted thread must
+ * still call init_rt_thread() itself.
+ */
+int litmus_admit_batch(struct litmus_admit_spec *specs, int num, int flags);
+
 /**
  * @todo Document
  */
@@ -288,6 +464,92 @@ void exit_np(void);
  */
 int  requested_to_preempt(void);
 
+/**
+ * Per-thread statistics about non-preemptive sections
+ *
+ * Only maintained by the inline enter_np_fast()/exit_np_fast() in
+ * fastpath.h, and only in code compiled with LITMUS_NP_STATS defined.
+ * Nested sections are counted as part of the outermost one.
+ */
+struct np_stats {
+	/** Number of completed (outermost) non-preemptive sections */
+	unsigned long sections;
+	/** Number of sections at whose end a preemption was pending */
+	unsigned long preempted;
+	/** Length of the longest section in cycles */
+	cycles_t longest;
+	/** @private Start of the current section */
+	cycles_t start;
+};
+
+/**
+ * Get the non-preemptive section statistics of the calling thread
+ * @param stats Filled with a copy of the current counters
+ */
+void get_np_stats(struct np_stats *stats);
+/**
+ * Reset the non-preemptive section statistics of the calling thread
+ */
+void reset_np_stats(void);
+
+/** Size of a non-preemptive spinlock, one cache line */
+#define NP_SPINLOCK_SIZE 64
+
+/**
+ * Ticket spinlock held non-preemptively
+ *
+ * The lock is taken and released entirely in user space; the holder and all
+ * spinning tasks are non-preemptive (see enter_np()), so a holder cannot be
+ * preempted while others wait for it. Intended for short critical sections
+ * shared across partitions, where litmus_lock() would cost more than the
+ * critical section itself. All-zero memory is an unlocked lock. Each lock
+ * occupies its own cache line, so that locks in an array do not interfere.
+ */
+struct np_spinlock {
+	/** @private Next ticket to hand out */
+	volatile uint32_t next;
+	/** @private Ticket currently being served */
+	volatile uint32_t owner;
+} __attribute__((aligned(NP_SPINLOCK_SIZE)));
+
+/**
+ * Initialize a non-preemptive spinlock to the unlocked state
+ * @param lock Lock to initialize, usually in shared memory
+ */
+void np_spinlock_init(struct np_spinlock *lock);
+/**
+ * Map an array of non-preemptive spinlocks shared by all users of a file
+ * @param name_space Backing file, created and grown as needed
+ * @param count Number of locks; lock IDs are indices into the array
+ * @return Pointer to the locks, or NULL on error
+ */
+struct np_spinlock* np_spinlocks_map(const char *name_space, int count);
+/**
+ * Unmap locks obtained by np_spinlocks_map()
+ * @param locks Pointer returned by np_spinlocks_map()
+ * @param count Number of locks passed to np_spinlocks_map()
+ * @return 0 on success
+ */
+int np_spinlocks_unmap(struct np_spinlock *locks, int count);
+/**
+ * Acquire a non-preemptive spinlock
+ *
+ * Enters a non-preemptive section and spins until the lock is granted.
+ * @param lock Lock to acquire
+ */
+void np_spin_lock(struct np_spinlock *lock);
+/**
+ * Try to acquire a non-preemptive spinlock without spinning
+ * @param lock Lock to acquire
+ * @return 1 iff the lock was acquired (and the caller is non-preemptive)
+ */
+int np_spin_trylock(struct np_spinlock *lock);
+/**
+ * Release a non-preemptive spinlock and leave the non-preemptive section
+ * @param lock Lock to release
+ */
+void np_spin_unlock(struct np_spinlock *lock);
+
 /***** Task System support *****/
 /**
  * Wait until task master releases all real-time tasks
@@ -309,7 +571,22 @@ int release_ts(lt_t *delay);
  */
 int get_nr_ts_release_waiters(void);
 /**
- * @todo Document
+ * Wait until enough tasks are waiting for the task system release
+ * @param expected Number of waiting tasks to wait for; 0 to wait until all
+ * real-time tasks are waiting
+ * @param timeout Maximum time to wait in nanoseconds, 0 for no limit
+ * @return Number of waiting tasks, or -1 on error (errno is ETIMEDOUT if
+ * the timeout expired)
+ *
+ * Polls /proc/litmus/stats, starting at microsecond intervals and backing
+ * off to milliseconds while no new tasks arrive.
+ */
+int wait_for_nr_ts_release_waiters(int expected, lt_t timeout);
+/**
+ * Read the task counters from /proc/litmus/stats
+ * @param ready Filled with the number of tasks waiting for release
+ * @param total Filled with the number of real-time tasks
+ * @return 1 on success, 0 otherwise
  */
 int read_litmus_stats(int *ready, int *total);
 
@@ -332,6 +609,86 @@ double cputime(void);
  */
 double wctime(void);
 
+/**
+ * Read CLOCK_MONOTONIC, without a system call where the vDSO provides it
+ * @return Monotonic time in nanoseconds
+ */
+lt_t litmus_clock(void);
+
+/**
+ * Sleep until an absolute point in time
+ * @param abs Wake-up time in nanoseconds on the litmus_clock() timeline
+ * (CLOCK_MONOTONIC)
+ * @return 0 on success
+ *
+ * Unlike repeated lt_sleep() calls, periodic loops built on this do not
+ * accumulate drift.
+ */
+int lt_sleep_until(lt_t abs);
+
+/**
+ * Sleep until shortly before an absolute point in time, then spin
+ * @param abs Wake-up time in nanoseconds on the litmus_clock() timeline
+ * @param margin How long before abs to stop sleeping and start spinning,
+ * in nanoseconds; should cover the typical wake-up latency
+ * @return 0 on success
+ *
+ * Trades up to margin nanoseconds of CPU time for a precise wake-up.
+ */
+int lt_sleep_until_hybrid(lt_t abs, lt_t margin);
+
+/**
+ * Obtain CPU time consumed so far by the calling thread
+ * @return CPU time in nanoseconds
+ */
+lt_t litmus_cputime(void);
+
+/**
+ * Calibrate the cycle counter against CLOCK_MONOTONIC_RAW
+ * @param duration Length of the calibration interval in nanoseconds
+ * (0 for the default of 100ms)
+ * @return 0 on success
+ *
+ * Required before cycles_to_ns() and cycles_clock() give meaningful results.
+ * The rate is measured against CLOCK_MONOTONIC_RAW, which NTP does not slew;
+ * cycles_clock() is anchored to CLOCK_MONOTONIC, like litmus_clock(). Longer
+ * intervals give tighter error bounds, see litmus_cycles_calibration().
+ */
+int litmus_calibrate_cycles(lt_t duration);
+
+/**
+ * Outcome of the last litmus_calibrate_cycles()
+ */
+struct litmus_cycles_calib {
+	double hz;		/**< Cycle counter frequency */
+	double error_ppm;	/**< Bound on the relative error of hz, in ppm */
+	lt_t duration;		/**< Length of the calibration interval in ns */
+};
+
+/**
+ * Obtain the outcome of the last cycle counter calibration
+ * @param calib Filled with the frequency and its error bound
+ * @return 0 on success, -1 if litmus_calibrate_cycles() did not succeed yet
+ */
+int litmus_cycles_calibration(struct litmus_cycles_calib *calib);
+
+/**
+ * Convert a cycle count to nanoseconds
+ * @param cycles Number of cycles (e.g., a difference of get_cycles() values)
+ * @return Corresponding time in nanoseconds
+ */
+lt_t cycles_to_ns(cycles_t cycles);
+
+/**
+ * Cycle-counter based clock on the CLOCK_MONOTONIC timeline
+ * @return Time in nanoseconds
+ *
+ * Cheaper than litmus_clock() where get_cycles() is a plain instruction
+ * (e.g., a constant-rate TSC), but only as accurate as the last
+ * litmus_calibrate_cycles(). Falls back to litmus_clock() if not calibrated.
+ */
+lt_t cycles_clock(void);
+
 /***** semaphore allocation ******/
 /**
  * Allocate a semaphore following the FMLP protocol
@@ -426,6 +783,155 @@ int set_mc2_task_param(pid_t pid, struct mc2_task* param);
 
 int set_page_color(int cpu);
 
+/***** job statistics *****/
+
+/**
+ * Keep job latency histograms for the calling thread
+ *
+ * From now on, each sleep_next_period() of the thread records the
+ * response time and tardiness of the completed job and the wake-up latency
+ * (time from release until the thread runs again) of the next job. The
+ * latter two depend on release times from the control page; without
+ * kernel support, only litmus_stats_record_job() feeds the histograms.
+ * @return 0 on success
+ */
+int litmus_stats_thread_init(void);
+/**
+ * Record a completed job in the calling thread's histograms
+ *
+ * For jobs not completed by sleep_next_period(). Ignored if the thread
+ * did not call litmus_stats_thread_init().
+ * @param release Release time of the job
+ * @param deadline Absolute deadline of the job
+ * @param completion Completion time of the job, e.g., cycles_clock()
+ */
+void litmus_stats_record_job(lt_t release, lt_t deadline, lt_t completion);
+/**
+ * Clear the histograms of all threads
+ *
+ * May be called while threads are recording; each thread clears its own
+ * histograms before it records the next value.
+ */
+void litmus_stats_reset(void);
+/**
+ * Print p50, p99, p99.9, and maximum of the histograms of all threads
+ * @param out Stream to print to
+ *
+ * Values are approximate (to within 1/16) except for the maximum.
+ */
+void litmus_stats_dump(FILE *out);
+
+/***** user-space event tracing *****/
+
+/** Events recorded by litmus_trace() */
+enum litmus_trace_event {
+	/** Application-defined job start, arg: job number */
+	LITMUS_EV_JOB_START = 1,
+	/** Application-defined job end, arg: job number */
+	LITMUS_EV_JOB_END,
+	/** Entering sleep_next_period() */
+	LITMUS_EV_SLEEP_NEXT_PERIOD,
+	/** Returning from sleep_next_period() */
+	LITMUS_EV_SLEEP_NEXT_PERIOD_DONE,
+	/** Requesting a lock, arg: object descriptor */
+	LITMUS_EV_LOCK_REQUEST,
+	/** Lock acquired, arg: object descriptor */
+	LITMUS_EV_LOCK_ACQUIRED,
+	/** Releasing a lock, arg: object descriptor */
+	LITMUS_EV_LOCK_RELEASE,
+	/** Lock released, arg: object descriptor */
+	LITMUS_EV_LOCK_RELEASED,
+	/** Entering the outermost non-preemptive section */
+	LITMUS_EV_NP_ENTER,
+	/** Leaving the outermost non-preemptive section */
+	LITMUS_EV_NP_EXIT,
+	/** Events were lost before this record (ring was full),
+	 *  arg: number of lost events */
+	LITMUS_EV_DROPPED,
+	LITMUS_EV_MAX
+};
+
+/** One trace record as stored in memory and in trace files */
+struct litmus_trace_rec {
+	/** get_cycles() at the time of the event */
+	uint64_t timestamp;
+	/** Event-specific argument */
+	uint32_t arg;
+	/** One of enum litmus_trace_event */
+	uint32_t event;
+};
+
+/** Magic number at the start of each chunk in a trace file */
+#define LITMUS_TRACE_MAGIC 0x4c545452 /* "LTTR" */
+
+/**
+ * Header of a chunk of records in a trace file
+ *
+ * A trace file is a sequence of chunks, each a header followed by count
+ * records of a single thread, in host byte order.
+ */
+struct litmus_trace_chunk {
+	/** LITMUS_TRACE_MAGIC */
+	uint32_t magic;
+	/** Thread that recorded the events */
+	uint32_t tid;
+	/** Number of records following the header */
+	uint32_t count;
+	/** Number of events lost after the last record (ring was full) and
+	 *  not followed by a LITMUS_EV_DROPPED record; only in the last chunk
+	 *  of a thread */
+	uint32_t dropped;
+};
+
+/**
+ * @private
+ * Nonzero while tracing is active
+ */
+extern int __litmus_trace_enabled;
+/**
+ * @private
+ * Append an event to the calling thread's ring
+ */
+void __litmus_trace_record(int event, uint32_t arg);
+
+/**
+ * Record an event in the calling thread's trace ring
+ *
+ * Costs a single, well-predicted branch while tracing is inactive. Events
+ * of threads without a ring (see litmus_trace_thread_init()) are ignored.
+ * @param event One of enum litmus_trace_event
+ * @param arg Event-specific argument
+ */
+#define litmus_trace(event, arg)					\
+	do {								\
+		if (__builtin_expect(__litmus_trace_enabled, 0))	\
+			__litmus_trace_record(event, arg);		\
+	} while (0)
+
+/**
+ * Start tracing to a file
+ *
+ * Enables the probes and starts a background thread that periodically
+ * drains all trace rings to the file.
+ * @param file Path of the trace file, truncated if it exists
+ * @return 0 on success
+ */
+int litmus_trace_start(const char *file);
+/**
+ * Set up a trace ring for the calling thread
+ *
+ * Must be called by each thread to be traced, before its hot path; the
+ * ring is allocated here so that recording events never allocates. Rings
+ * are kept until the process exits.
+ * @return 0 on success
+ */
+int litmus_trace_thread_init(void);
+/**
+ * Stop tracing, drain all rings, and close the trace file
+ * @return Total number of events lost because a ring was full
+ */
+unsigned long litmus_trace_stop(void);
+
 #ifdef __cplusplus
 }
 #endif
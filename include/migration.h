@@ -21,13 +21,13 @@ pid_t gettid();
 int be_migrate_thread_to_cpu(pid_t tid, int target_cpu);
 
 /**
- * Migrate current task to a given cluster
+ * Migrate a task to a given scheduling domain (i.e., cluster or partition)
  * @param tid Process ID for migrated task, 0 for current task
  * @param domain Cluster ID to migrate the task to
  * @pre tid is not yet in real-time mode (it's a best effort task)
  * @return 0 if successful
  */
-int be_migrate_thread_to_cluster(pid_t tid, int domain);
+int be_migrate_thread_to_domain(pid_t tid, int domain);
 
 /**
  * Migrate current task to a given CPU
@@ -64,10 +64,55 @@ int be_migrate_to_domain(int domain);
 int num_online_cpus();
 
 /**
- * @todo Document!
+ * Re-read the CPU/domain topology from /proc/litmus
+ * @return 0 on success
+ *
+ * The topology of the active plugin is read once per process, upon first
+ * use, and served from memory thereafter. Long-running processes must call
+ * this after the active plugin, the release master, or the set of online
+ * CPUs changed.
+ */
+int litmus_refresh_topology(void);
+
+/**
+ * Return the number of scheduling domains (clusters or partitions) of the
+ * active plugin
+ * @return Number of domains, or -1 on error
+ */
+int num_domains();
+
+/**
+ * Return the CPU that serves as the release master
+ * @return The release master's CPU, or -1 if there is none
  */
 int release_master();
 int domain_to_cpus(int domain, unsigned long long int* mask);
 int cpu_to_domains(int cpu, unsigned long long int* mask);
 
 int domain_to_first_cpu(int domain);
+
+/* cpu_set_t-based interface, available if <sched.h> was included (with
+ * _GNU_SOURCE) before litmus.h. */
+#ifdef CPU_SETSIZE
+/**
+ * Obtain the CPUs that belong to a scheduling domain
+ * @param domain The cluster/partition to look up
+ * @param setsize Size of set in bytes (see CPU_ALLOC_SIZE())
+ * @param set CPU set to fill
+ * @return 0 on success, -1 if domain is invalid or set too small
+ *
+ * Unlike domain_to_cpus(), not limited to 64 CPUs.
+ */
+int domain_to_cpuset(int domain, size_t setsize, cpu_set_t *set);
+
+/**
+ * Obtain the scheduling domains that a CPU belongs to
+ * @param cpu The CPU to look up
+ * @param setsize Size of set in bytes (see CPU_ALLOC_SIZE())
+ * @param set Set to fill; bit i corresponds to domain i
+ * @return 0 on success, -1 if cpu is invalid or set too small
+ *
+ * Unlike cpu_to_domains(), not limited to 64 domains.
+ */
+int cpu_to_domainset(int cpu, size_t setsize, cpu_set_t *set);
+#endif
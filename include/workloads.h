@@ -0,0 +1,40 @@
+/**
+ * @file workloads.h
+ * Compute kernels for the spinning tools
+ */
+
+#ifndef WORKLOADS_H
+#define WORKLOADS_H
+
+#include "common.h"
+
+/**
+ * Unit of work that resembles a real application more than the default
+ * array walk
+ *
+ * Kernels keep their buffers in thread-local storage, so every thread that
+ * spins with a kernel must call its init() before using work(), e.g., before
+ * becoming a real-time task.
+ */
+struct workload {
+	const char *name;	/**< Name for the -W option */
+	const char *desc;	/**< One-line description */
+	/** Allocate and fill the calling thread's buffers; 0 on success */
+	int (*init)(void);
+	spin_work_t work;	/**< One unit of work, a few microseconds long */
+};
+
+/**
+ * Look up a workload by name
+ * @param name Name of the workload
+ * @return The workload, or NULL if there is none with this name
+ */
+const struct workload* find_workload(const char *name);
+
+/**
+ * Print the names and descriptions of all workloads
+ * @param out Stream to print to
+ */
+void list_workloads(FILE *out);
+
+#endif
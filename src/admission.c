@@ -0,0 +1,189 @@
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <sched.h> /* for cpu sets */
+
+#include "litmus.h"
+#include "internal.h"
+
+/* Bulk admission of real-time threads.
+ *
+ * Entries are bucketed by domain. Each worker thread is pinned to the domain
+ * of its home bucket, drains that bucket first, and then helps out with the
+ * remaining buckets, so that admission time scales with the number of CPUs
+ * rather than the number of threads.
+ */
+
+struct admit_bucket {
+	int domain;		/* -1: global (no migration) */
+	int *idx;		/* indices into specs[] */
+	int len;
+	volatile int next;	/* next entry to claim */
+};
+
+struct admit_batch {
+	struct litmus_admit_spec *specs;
+	int flags;
+	struct admit_bucket *buckets;
+	int num_buckets;
+	volatile int admitted;
+};
+
+struct admit_worker {
+	struct admit_batch *batch;
+	int home;		/* index of home bucket */
+};
+
+static int admit_one(struct litmus_admit_spec *spec, int flags)
+{
+	struct sched_param param;
+
+	if (spec->domain >= 0) {
+		/* not every failure path of the migration sets errno */
+		errno = 0;
+		if (be_migrate_thread_to_domain(spec->tid, spec->domain) != 0)
+			return errno ? errno : EINVAL;
+		spec->param.cpu = domain_to_first_cpu(spec->domain);
+	}
+
+	if (set_rt_task_param(spec->tid, &spec->param) != 0)
+		return errno;
+
+	if (flags & LITMUS_ADMIT_RT_MODE) {
+		param.sched_priority = 0;
+		if (sched_setscheduler(spec->tid, SCHED_LITMUS, &param) != 0)
+			return errno;
+	}
+
+	return 0;
+}
+
+static void drain_bucket(struct admit_batch *batch, struct admit_bucket *b)
+{
+	struct litmus_admit_spec *spec;
+	int i;
+
+	while ((i = __sync_fetch_and_add(&b->next, 1)) < b->len) {
+		spec = batch->specs + b->idx[i];
+		spec->status = admit_one(spec, batch->flags);
+		if (!spec->status)
+			__sync_fetch_and_add(&batch->admitted, 1);
+	}
+}
+
+static void* admit_worker(void *arg)
+{
+	struct admit_worker *w = arg;
+	struct admit_batch *batch = w->batch;
+	int i;
+
+	if (batch->buckets[w->home].domain >= 0)
+		/* best effort; admission works from any CPU */
+		be_migrate_thread_to_domain(0, batch->buckets[w->home].domain);
+
+	for (i = 0; i < batch->num_buckets; i++)
+		drain_bucket(batch,
+			     batch->buckets + (w->home + i) % batch->num_buckets);
+
+	return NULL;
+}
+
+int litmus_admit_batch(struct litmus_admit_spec *specs, int num, int flags)
+{
+	struct admit_batch batch;
+	struct admit_worker *workers = NULL;
+	pthread_t *threads = NULL;
+	int *idx = NULL;
+	int ndom, i, b, num_workers, started = 0;
+
+	if (num < 0 || (num > 0 && !specs)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	ndom = num_domains();
+	if (ndom < 0)
+		ndom = 0;
+
+	batch.specs = specs;
+	batch.flags = flags;
+	batch.admitted = 0;
+	/* bucket 0 holds global entries, bucket d + 1 those of domain d */
+	batch.num_buckets = ndom + 1;
+	batch.buckets = calloc(batch.num_buckets, sizeof(*batch.buckets));
+	idx = malloc(num * sizeof(*idx));
+	/* malloc(0) may return NULL */
+	if (!batch.buckets || (num && !idx))
+		goto out_nomem;
+
+	for (i = 0; i < num; i++) {
+		/* tid 0 would admit (and migrate) a worker thread */
+		if (specs[i].tid <= 0 ||
+		    specs[i].domain < -1 || specs[i].domain >= ndom) {
+			specs[i].status = EINVAL;
+			continue;
+		}
+		specs[i].status = -1;
+		batch.buckets[specs[i].domain + 1].len++;
+	}
+	for (b = 0, i = 0; b < batch.num_buckets; b++) {
+		batch.buckets[b].domain = b - 1;
+		batch.buckets[b].idx = idx + i;
+		i += batch.buckets[b].len;
+		batch.buckets[b].len = 0;
+	}
+	for (i = 0; i < num; i++)
+		if (specs[i].status == -1) {
+			b = specs[i].domain + 1;
+			batch.buckets[b].idx[batch.buckets[b].len++] = i;
+		}
+
+	/* one worker per non-empty bucket, but no more than there are CPUs */
+	num_workers = 0;
+	for (b = 0; b < batch.num_buckets; b++)
+		if (batch.buckets[b].len)
+			num_workers++;
+	if (num_workers > num_online_cpus())
+		num_workers = num_online_cpus();
+
+	workers = calloc(num_workers, sizeof(*workers));
+	threads = calloc(num_workers, sizeof(*threads));
+	if (num_workers && (!workers || !threads))
+		goto out_nomem;
+
+	for (b = 0, i = 0; b < batch.num_buckets && i < num_workers; b++)
+		if (batch.buckets[b].len) {
+			workers[i].batch = &batch;
+			workers[i].home = b;
+			if (pthread_create(threads + i, NULL,
+					   admit_worker, workers + i) == 0)
+				started++;
+			else
+				workers[i].batch = NULL;
+			i++;
+		}
+
+	if (started < num_workers)
+		/* could not start all workers; pick up the slack ourselves */
+		for (b = 0; b < batch.num_buckets; b++)
+			drain_bucket(&batch, batch.buckets + b);
+
+	for (i = 0; i < num_workers; i++)
+		if (workers[i].batch)
+			pthread_join(threads[i], NULL);
+
+	free(threads);
+	free(workers);
+	free(batch.buckets);
+	free(idx);
+	return batch.admitted;
+
+out_nomem:
+	free(threads);
+	free(workers);
+	free(batch.buckets);
+	free(idx);
+	errno = ENOMEM;
+	return -1;
+}
@@ -1,9 +1,11 @@
 #include <stdio.h>
+#include <errno.h>
 
 #include <sys/time.h>
 #include <time.h>
 
 #include "litmus.h"
+#include "internal.h"
 
 /* CPU time consumed so far in seconds */
 double cputime(void)
@@ -32,3 +34,161 @@ int lt_sleep(lt_t timeout)
 	delay.tv_nsec = timeout % 1000000000L;
 	return nanosleep(&delay, NULL);
 }
+
+static inline lt_t timespec2ns(const struct timespec *ts)
+{
+	return s2ns((lt_t) ts->tv_sec) + ts->tv_nsec;
+}
+
+/* CLOCK_MONOTONIC is served from the vDSO on all architectures we care about,
+ * so this does not enter the kernel. */
+lt_t litmus_clock(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return timespec2ns(&ts);
+}
+
+lt_t litmus_cputime(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return timespec2ns(&ts);
+}
+
+int lt_sleep_until(lt_t abs)
+{
+	struct timespec when;
+	int err;
+
+	when.tv_sec  = abs / 1000000000L;
+	when.tv_nsec = abs % 1000000000L;
+	/* with TIMER_ABSTIME, restarting after a signal is trivial */
+	do {
+		err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+				      &when, NULL);
+	} while (err == EINTR);
+
+	if (err) {
+		errno = err;
+		return -1;
+	}
+	return 0;
+}
+
+int lt_sleep_until_hybrid(lt_t abs, lt_t margin)
+{
+	if (abs > margin && litmus_clock() < abs - margin &&
+	    lt_sleep_until(abs - margin) != 0)
+		return -1;
+
+	while (litmus_clock() < abs)
+		; /* spin for the last stretch */
+
+	return 0;
+}
+
+/* Cycle counter -> nanoseconds conversion: ns = (cycles * mult) >> SHIFT,
+ * anchored at a (cycles, CLOCK_MONOTONIC) sample taken during calibration.
+ * The rate is measured against CLOCK_MONOTONIC_RAW, which NTP does not
+ * slew. */
+#define CYCLES_SHIFT 24
+
+static struct {
+	cycles_t base_cycles;
+	lt_t base_ns;
+	uint64_t mult;
+	int calibrated;
+	struct litmus_cycles_calib calib;
+} cycles_conv;
+
+static lt_t read_clock(clockid_t clock)
+{
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return timespec2ns(&ts);
+}
+
+/* Take a (cycles, clock) pair, keeping the tightest of a few bracketing
+ * attempts to minimize the error due to interrupts. Returns the width of
+ * the bracket, i.e., twice the bound on the error of *ns. */
+static lt_t sample_clocks(clockid_t clock, cycles_t *cycles, lt_t *ns)
+{
+	lt_t before, after, best = ~0ULL;
+	cycles_t c;
+	int i;
+
+	for (i = 0; i < 10; i++) {
+		before = read_clock(clock);
+		c = get_cycles();
+		after = read_clock(clock);
+		if (after - before < best) {
+			best = after - before;
+			*cycles = c;
+			*ns = before + (after - before) / 2;
+		}
+	}
+	return best;
+}
+
+int litmus_calibrate_cycles(lt_t duration)
+{
+	cycles_t c0, c1, anchor;
+	lt_t t0, t1, w0, w1, anchor_ns;
+
+	if (!duration)
+		duration = ms2ns(100);
+
+	w0 = sample_clocks(CLOCK_MONOTONIC_RAW, &c0, &t0);
+	if (lt_sleep(duration) != 0)
+		return -1;
+	w1 = sample_clocks(CLOCK_MONOTONIC_RAW, &c1, &t1);
+	sample_clocks(CLOCK_MONOTONIC, &anchor, &anchor_ns);
+
+	if (c1 <= c0 || t1 <= t0)
+		return -1;
+
+	cycles_conv.mult = ((t1 - t0) << CYCLES_SHIFT) / (uint64_t) (c1 - c0);
+	cycles_conv.base_cycles = anchor;
+	cycles_conv.base_ns = anchor_ns;
+	cycles_conv.calib.hz = (c1 - c0) / ((t1 - t0) / 1E9);
+	/* each endpoint is off by at most half its bracket */
+	cycles_conv.calib.error_ppm = (w0 + w1) / 2.0 / (t1 - t0) * 1E6;
+	cycles_conv.calib.duration = t1 - t0;
+	__sync_synchronize();
+	cycles_conv.calibrated = 1;
+	return 0;
+}
+
+int litmus_cycles_calibration(struct litmus_cycles_calib *calib)
+{
+	if (!cycles_conv.calibrated)
+		return -1;
+	*calib = cycles_conv.calib;
+	return 0;
+}
+
+lt_t cycles_to_ns(cycles_t cycles)
+{
+	uint64_t c = cycles, hi = c >> 32, lo = c & 0xffffffffULL;
+
+	/* split to avoid overflowing 64 bits for large cycle counts */
+	return ((hi * cycles_conv.mult) << (32 - CYCLES_SHIFT)) +
+		((lo * cycles_conv.mult) >> CYCLES_SHIFT);
+}
+
+lt_t cycles_clock(void)
+{
+	cycles_t now;
+
+	if (unlikely(!cycles_conv.calibrated))
+		return litmus_clock();
+
+	now = get_cycles();
+	/* a CPU with a slightly lagging counter may read below the anchor */
+	if (unlikely(now < cycles_conv.base_cycles))
+		return cycles_conv.base_ns -
+			cycles_to_ns(cycles_conv.base_cycles - now);
+	return cycles_conv.base_ns +
+		cycles_to_ns(now - cycles_conv.base_cycles);
+}
@@ -2,11 +2,22 @@
 #include <sys/fcntl.h> /* for O_RDWR */
 #include <sys/unistd.h>
 #include <sched.h> /* for sched_yield() */
+#include <pthread.h> /* for pthread_atfork() */
+
+/* imported from the kernel source tree */
+#include "asm/unistd.h"
+
+/* for syscall() */
+#include <unistd.h>
 
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 
 #include "litmus.h"
+#include "fastpath.h"
 #include "internal.h"
 
 #define LITMUS_CTRL_DEVICE "/dev/litmus/ctrl"
@@ -56,18 +67,56 @@ ssize_t read_file(const char* fname, void* buf, size_t maxlen)
 		return got;
 }
 
+/* /proc/litmus/stats is polled in tight loops while a task system is being
+ * set up, so keep the file open and re-read it with pread(). */
+static int stats_fd = -1;
+
+static int get_stats_fd(void)
+{
+	int fd = stats_fd;
+
+	if (fd < 0) {
+		fd = open(LITMUS_STATS_FILE, O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			return -1;
+		if (!__sync_bool_compare_and_swap(&stats_fd, -1, fd)) {
+			/* somebody else was faster */
+			close(fd);
+			fd = stats_fd;
+		}
+	}
+	return fd;
+}
+
+/* parse the number following the next '=' */
+static int parse_stat(const char **pos, int *val)
+{
+	char *end;
+	const char *eq = strchr(*pos, '=');
+
+	if (!eq)
+		return 0;
+	*val = strtol(eq + 1, &end, 10);
+	*pos = end;
+	return end != eq + 1;
+}
+
 int read_litmus_stats(int *ready, int *all)
 {
+	/* "real-time tasks   = %d\nready for release = %d\n" */
 	char buf[100];
+	const char *pos = buf;
 	ssize_t len;
+	int fd = get_stats_fd();
+
+	if (fd < 0)
+		return 0;
+	len = pread(fd, buf, sizeof(buf) - 1, 0);
+	if (len <= 0)
+		return 0;
+	buf[len] = '\0';
 
-	len = read_file(LITMUS_STATS_FILE, buf, sizeof(buf) - 1);
-	if (len >= 0)
-		len = sscanf(buf,
-			     "real-time tasks   = %d\n"
-			     "ready for release = %d\n",
-			     all, ready);
-	return len == 2;
+	return parse_stat(&pos, all) && parse_stat(&pos, ready);
 }
 
 int get_nr_ts_release_waiters(void)
@@ -79,11 +128,62 @@ int get_nr_ts_release_waiters(void)
 		return -1;
 }
 
-/* thread-local pointer to control page */
-static __thread struct control_page *ctrl_page;
+/* polling interval bounds for wait_for_nr_ts_release_waiters() */
+#define TS_POLL_MIN us2ns(10)
+#define TS_POLL_MAX ms2ns(1)
+
+int wait_for_nr_ts_release_waiters(int expected, lt_t timeout)
+{
+	int ready, all, last_ready = -1;
+	lt_t poll = TS_POLL_MIN, deadline = 0, now;
+
+	if (timeout)
+		deadline = litmus_clock() + timeout;
+
+	while (1) {
+		if (!read_litmus_stats(&ready, &all))
+			return -1;
+		if (expected ? ready >= expected : ready >= all)
+			return ready;
+
+		if (deadline) {
+			now = litmus_clock();
+			if (now >= deadline) {
+				errno = ETIMEDOUT;
+				return -1;
+			}
+			if (now + poll > deadline)
+				poll = deadline - now;
+		}
+		lt_sleep(poll);
+
+		/* Back off exponentially while nothing is happening, but poll
+		 * quickly again once tasks arrive: the last one may be close. */
+		if (ready != last_ready)
+			poll = TS_POLL_MIN;
+		else
+			poll = poll * 2 > TS_POLL_MAX ? TS_POLL_MAX : poll * 2;
+		last_ready = ready;
+	}
+}
+
+/* thread-local pointer to control page, shared with the inline fast paths in
+ * fastpath.h */
+__thread struct control_page *__litmus_ctrl_page;
+
+/* per-thread NP section statistics, maintained by fastpath.h */
+__thread struct np_stats __litmus_np_stats;
+
+/* The control page mapping is not inherited across fork(), so the child must
+ * not keep using the parent's (now dangling) pointer. */
+static void forget_ctrl_page(void)
+{
+	__litmus_ctrl_page = NULL;
+}
 
 int init_kernel_iface(void)
 {
+	static int atfork_registered = 0;
 	int err = 0;
 	long page_size = sysconf(_SC_PAGESIZE);
 	void* mapped_at = NULL;
@@ -98,13 +198,24 @@ int init_kernel_iface(void)
 		     != LITMUS_CP_OFFSET_TS_SC_START);
 	BUILD_BUG_ON(offsetof(struct control_page, irq_syscall_start)
 		     != LITMUS_CP_OFFSET_IRQ_SC_START);
+#ifdef LITMUS_CP_OFFSET_JOB_INDEX
+	BUILD_BUG_ON(offsetof(struct control_page, deadline)
+		     != LITMUS_CP_OFFSET_DEADLINE);
+	BUILD_BUG_ON(offsetof(struct control_page, release)
+		     != LITMUS_CP_OFFSET_RELEASE);
+	BUILD_BUG_ON(offsetof(struct control_page, job_index)
+		     != LITMUS_CP_OFFSET_JOB_INDEX);
+#endif
+
+	if (__sync_bool_compare_and_swap(&atfork_registered, 0, 1))
+		pthread_atfork(NULL, NULL, forget_ctrl_page);
 
 	err = map_file(LITMUS_CTRL_DEVICE, &mapped_at, CTRL_PAGES * page_size);
 
 	/* Assign ctrl_page indirectly to avoid GCC warnings about aliasing
 	 * related to type pruning.
 	 */
-	ctrl_page = mapped_at;
+	__litmus_ctrl_page = mapped_at;
 
 	if (err) {
 		fprintf(stderr, "%s: cannot open LITMUS^RT control page (%m)\n",
@@ -116,8 +227,8 @@ int init_kernel_iface(void)
 
 void enter_np(void)
 {
-	if (likely(ctrl_page != NULL) || init_kernel_iface() == 0)
-		ctrl_page->sched.np.flag++;
+	if (likely(__litmus_ctrl_page != NULL) || init_kernel_iface() == 0)
+		enter_np_fast();
 	else
 		fprintf(stderr, "enter_np: control page not mapped!\n");
 }
@@ -125,19 +236,24 @@ void enter_np(void)
 
 void exit_np(void)
 {
-	if (likely(ctrl_page != NULL) &&
-	    ctrl_page->sched.np.flag &&
-	    !(--ctrl_page->sched.np.flag)) {
-		/* became preemptive, let's check for delayed preemptions */
-		__sync_synchronize();
-		if (ctrl_page->sched.np.preempt)
-			sched_yield();
-	}
+	if (likely(__litmus_ctrl_page != NULL))
+		exit_np_fast();
+}
+
+void get_np_stats(struct np_stats *stats)
+{
+	*stats = __litmus_np_stats;
+}
+
+void reset_np_stats(void)
+{
+	memset(&__litmus_np_stats, 0, sizeof(__litmus_np_stats));
 }
 
 int requested_to_preempt(void)
 {
-	return (likely(ctrl_page != NULL) && ctrl_page->sched.np.preempt);
+	return (likely(__litmus_ctrl_page != NULL) &&
+		__litmus_ctrl_page->sched.np.preempt);
 }
 
 /* init and return a ptr to the control page for
@@ -147,9 +263,75 @@ int requested_to_preempt(void)
  */
 struct control_page* get_ctrl_page(void)
 {
-	if((ctrl_page != NULL) || init_kernel_iface() == 0)
-		return ctrl_page;
+	if((__litmus_ctrl_page != NULL) || init_kernel_iface() == 0)
+		return __litmus_ctrl_page;
 	else
 		return NULL;
 }
 
+
+/* Read the parameters of the current job without entering the kernel.
+ *
+ * Job numbers start at one, so a job_index of zero means that the kernel has
+ * not (yet) set up a job for this thread, e.g., because it is not a real-time
+ * task. In that case, we let the system call report the appropriate error.
+ *
+ * The kernel only rewrites the job fields of the control page when it sets up
+ * the next job of this task, i.e., while this thread is not executing user
+ * code. job_index therefore acts as the sequence count of a seqlock: if it
+ * reads the same before and after the other fields were copied, the snapshot
+ * belongs to a single job. Otherwise we raced with a release and retry.
+ *
+ * Kernels that do not export the job fields in the control page only provide
+ * the job number (via the system call); release and deadline are reported as
+ * zero in that case.
+ */
+int get_job_info(struct litmus_job_info *info)
+{
+#ifdef LITMUS_CP_OFFSET_JOB_INDEX
+	volatile struct control_page *cp = __litmus_ctrl_page;
+	uint64_t seq;
+
+	if (likely(cp != NULL && cp->job_index != 0)) {
+		do {
+			seq = cp->job_index;
+			__sync_synchronize();
+			info->release  = cp->release;
+			info->deadline = cp->deadline;
+			__sync_synchronize();
+		} while (unlikely(seq != cp->job_index));
+		info->job_no = (unsigned int) seq;
+		return 0;
+	}
+#endif
+	info->release  = 0;
+	info->deadline = 0;
+	return syscall(__NR_query_job_no, &info->job_no);
+}
+
+int get_job_no(unsigned int *job_no)
+{
+#ifdef LITMUS_CP_OFFSET_JOB_INDEX
+	volatile struct control_page *cp = __litmus_ctrl_page;
+
+	if (likely(cp != NULL && cp->job_index != 0)) {
+		*job_no = (unsigned int) cp->job_index;
+		return 0;
+	}
+#endif
+	return syscall(__NR_query_job_no, job_no);
+}
+
+int wait_for_job_release(unsigned int job_no)
+{
+#ifdef LITMUS_CP_OFFSET_JOB_INDEX
+	volatile struct control_page *cp = __litmus_ctrl_page;
+
+	/* Nothing to wait for if the requested job has already been released.
+	 * Signed difference to survive wrap-around of the job counter. */
+	if (likely(cp != NULL && cp->job_index != 0) &&
+	    (int) ((unsigned int) cp->job_index - job_no) >= 0)
+		return 0;
+#endif
+	return syscall(__NR_wait_for_job_release, job_no);
+}
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <signal.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/types.h>
@@ -61,14 +62,64 @@ int litmus_open_lock(
 {
 	int fd, od;
 
-	fd = open(namespace, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+	fd = litmus_open_namespace(namespace);
 	if (fd < 0)
 		return -1;
-	od = od_openx(fd, protocol, lock_id, config_param);
-	close(fd);
+	od = litmus_open_lock_ns(fd, protocol, lock_id, config_param);
+	litmus_close_namespace(fd);
 	return od;
 }
 
+int litmus_open_namespace(const char* namespace)
+{
+	return open(namespace, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+}
+
+int litmus_close_namespace(int ns)
+{
+	return close(ns);
+}
+
+int litmus_open_lock_ns(
+	int ns,
+	obj_type_t protocol,
+	int lock_id,
+	void *config_param)
+{
+	return od_openx(ns, protocol, lock_id, config_param);
+}
+
+int litmus_open_locks(int ns, struct litmus_lock_spec *specs, int num)
+{
+	int i, err;
+
+	for (i = 0; i < num; i++) {
+		specs[i].od = litmus_open_lock_ns(ns, specs[i].protocol,
+						  specs[i].lock_id,
+						  specs[i].config_param);
+		if (specs[i].od < 0) {
+			/* all or nothing; keep the errno of the failed open */
+			err = errno;
+			litmus_close_locks(specs, i);
+			errno = err;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int litmus_close_locks(struct litmus_lock_spec *specs, int num)
+{
+	int i, ret = 0;
+
+	for (i = 0; i < num; i++) {
+		if (specs[i].od >= 0 && od_close(specs[i].od) != 0)
+			ret = -1;
+		specs[i].od = -1;
+	}
+	return ret;
+}
+
 
 
 void show_rt_param(struct rt_task* tp)
@@ -1,14 +1,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <sched.h> /* for cpu sets */
 #include <unistd.h>
 
 #include "migration.h"
+#include "internal.h"
 
-extern ssize_t read_file(const char* fname, void* buf, size_t maxlen);
-
-int release_master()
+static int read_release_master(void)
 {
 	static const char NO_CPU[] = "NO_CPU";
 	char buf[7] = {0}; /* up to 999999 CPUs */
@@ -22,11 +22,6 @@ int release_master()
 	return master;
 }
 
-int num_online_cpus()
-{
-	return sysconf(_SC_NPROCESSORS_ONLN);
-}
-
 static int read_mapping(int idx, const char* which, cpu_set_t** set, size_t *sz)
 {
 	/* Max CPUs = 4096 */
@@ -45,7 +40,7 @@ static int read_mapping(int idx, const char* which, cpu_set_t** set, size_t *sz)
 	*set = NULL;
 	*sz = 0;
 
-	if (num_online_cpus() > 4096)
+	if (sysconf(_SC_NPROCESSORS_ONLN) > 4096)
 		goto out;
 
 	/* Read string is in the format of <mask>[,<mask>]*. All <mask>s following
@@ -57,6 +52,9 @@ static int read_mapping(int idx, const char* which, cpu_set_t** set, size_t *sz)
 		goto out;
 
 	len = strnlen(buf, sizeof(buf));
+	/* drop the trailing newline, it would misalign the 8-char chunks */
+	while (len > 0 && (buf[len - 1] == '\n' || buf[len - 1] == ' '))
+		buf[--len] = '\0';
 	nbits = 32*(len/9) + 4*(len%9); /* compute bits, accounting for commas */
 
 	*set = CPU_ALLOC(nbits);
@@ -88,6 +86,192 @@ out:
 	return ret;
 }
 
+/* Process-wide snapshot of the CPU <-> domain mapping of the active plugin.
+ * It is read from /proc/litmus upon first use and replaced only by
+ * litmus_refresh_topology(). All sets are 'setsize' bytes long and stored
+ * back to back. */
+struct topology {
+	int num_cpus;		/* online CPUs */
+	int num_domains;
+	int release_master;
+	int nbits;		/* capacity of each set */
+	size_t setsize;
+	char *domain_cpus;	/* CPUs of each domain */
+	char *cpu_domains;	/* domains of each CPU */
+	int *first_cpu;		/* lowest-numbered CPU of each domain */
+};
+
+static struct topology *topology;
+
+#define TOPO_SET(t, arr, idx) \
+	((cpu_set_t*) ((t)->arr + (size_t) (idx) * (t)->setsize))
+
+static void free_topology(struct topology *t)
+{
+	free(t->domain_cpus);
+	free(t->cpu_domains);
+	free(t->first_cpu);
+	free(t);
+}
+
+static struct topology* load_topology(void)
+{
+	struct topology *t;
+	cpu_set_t **sets = NULL, **tmp;
+	size_t *sizes = NULL, *tmp_sz;
+	int nbits, d, i;
+
+	t = calloc(1, sizeof(*t));
+	if (!t)
+		return NULL;
+
+	t->num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	t->release_master = read_release_master();
+	nbits = t->num_cpus;
+
+	/* read the domain masks until we run out of domains */
+	for (d = 0; ; d++) {
+		tmp = realloc(sets, (d + 1) * sizeof(*sets));
+		tmp_sz = realloc(sizes, (d + 1) * sizeof(*sizes));
+		if (tmp)
+			sets = tmp;
+		if (tmp_sz)
+			sizes = tmp_sz;
+		if (!tmp || !tmp_sz)
+			goto fail;
+		if (read_mapping(d, "domains", sets + d, sizes + d) != 0)
+			break;
+		if (sizes[d] * 8 > nbits)
+			nbits = sizes[d] * 8;
+	}
+	t->num_domains = d;
+	if (t->num_domains > nbits)
+		nbits = t->num_domains;
+
+	t->nbits = nbits;
+	t->setsize = CPU_ALLOC_SIZE(nbits);
+	t->domain_cpus = calloc(t->num_domains + 1, t->setsize);
+	t->cpu_domains = calloc(nbits, t->setsize);
+	t->first_cpu = calloc(t->num_domains + 1, sizeof(int));
+	if (!t->domain_cpus || !t->cpu_domains || !t->first_cpu)
+		goto fail;
+
+	/* normalize set sizes and invert the mapping */
+	for (d = 0; d < t->num_domains; d++) {
+		t->first_cpu[d] = -1;
+		for (i = sizes[d] * 8 - 1; i >= 0; i--)
+			if (CPU_ISSET_S(i, sizes[d], sets[d])) {
+				CPU_SET_S(i, t->setsize, TOPO_SET(t, domain_cpus, d));
+				CPU_SET_S(d, t->setsize, TOPO_SET(t, cpu_domains, i));
+				t->first_cpu[d] = i;
+			}
+		CPU_FREE(sets[d]);
+	}
+	free(sets);
+	free(sizes);
+
+	return t;
+
+fail:
+	for (i = 0; i < d; i++)
+		CPU_FREE(sets[i]);
+	free(sets);
+	free(sizes);
+	free_topology(t);
+	return NULL;
+}
+
+int litmus_refresh_topology(void)
+{
+	struct topology *t = load_topology();
+
+	if (!t)
+		return -1;
+
+	/* Other threads may still be looking at the previous snapshot, so it
+	 * is not freed. Refreshing is expected to be rare (e.g., after a
+	 * plugin switch). */
+	__sync_synchronize();
+	topology = t;
+	return 0;
+}
+
+static struct topology* get_topology(void)
+{
+	struct topology *t = topology;
+
+	if (unlikely(t == NULL)) {
+		t = load_topology();
+		if (!t)
+			return NULL;
+		if (!__sync_bool_compare_and_swap(&topology, NULL, t)) {
+			/* somebody else was faster */
+			free_topology(t);
+			t = topology;
+		}
+	}
+	return t;
+}
+
+static int copy_set(const cpu_set_t *from, size_t from_sz,
+		    cpu_set_t *to, size_t to_sz)
+{
+	int i;
+
+	CPU_ZERO_S(to_sz, to);
+	for (i = 0; i < from_sz * 8; i++)
+		if (CPU_ISSET_S(i, from_sz, from)) {
+			if (i >= to_sz * 8) {
+				errno = EINVAL;
+				return -1;
+			}
+			CPU_SET_S(i, to_sz, to);
+		}
+	return 0;
+}
+
+int release_master()
+{
+	struct topology *t = get_topology();
+	return t ? t->release_master : -1;
+}
+
+int num_online_cpus()
+{
+	struct topology *t = get_topology();
+	return t ? t->num_cpus : sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+int num_domains()
+{
+	struct topology *t = get_topology();
+	return t ? t->num_domains : -1;
+}
+
+int domain_to_cpuset(int domain, size_t setsize, cpu_set_t *set)
+{
+	struct topology *t = get_topology();
+
+	if (!t || domain < 0 || domain >= t->num_domains) {
+		errno = EINVAL;
+		return -1;
+	}
+	return copy_set(TOPO_SET(t, domain_cpus, domain), t->setsize,
+			set, setsize);
+}
+
+int cpu_to_domainset(int cpu, size_t setsize, cpu_set_t *set)
+{
+	struct topology *t = get_topology();
+
+	if (!t || cpu < 0 || cpu >= t->nbits) {
+		errno = EINVAL;
+		return -1;
+	}
+	return copy_set(TOPO_SET(t, cpu_domains, cpu), t->setsize,
+			set, setsize);
+}
+
 static unsigned long long int cpusettoull(cpu_set_t* bits, size_t sz)
 {
 	unsigned long long mask = 0;
@@ -102,73 +286,49 @@ static unsigned long long int cpusettoull(cpu_set_t* bits, size_t sz)
 	return mask;
 }
 
-int domain_to_cpus(int domain, unsigned long long int* mask)
+/* Pack a cached set into a 64-bit mask. Fails if it has members beyond
+ * bit 63; use domain_to_cpuset() / cpu_to_domainset() on larger machines. */
+static int set_to_ull(const cpu_set_t *bits, size_t sz,
+		      unsigned long long int* mask)
 {
-	/* TODO: Support more than 64 CPUs. Instead of using 'ull' for 'mask',
-	   consider using gcc's __uint128_t or some struct. */
+	int i;
 
-	cpu_set_t *bits;
-	size_t sz;
-	int ret;
+	for (i = sizeof(*mask)*8; i < sz * 8; i++)
+		if (CPU_ISSET_S(i, sz, bits))
+			return -1;
 
-	/* number of CPUs exceeds what we can pack in ull */
-	if (num_online_cpus() > sizeof(unsigned long long int)*8)
-		return -1;
+	*mask = cpusettoull((cpu_set_t*) bits, sz);
+	return 0;
+}
 
-	ret = read_mapping(domain, "domains", &bits, &sz);
-	if (!ret) {
-		*mask = cpusettoull(bits, sz);
-		CPU_FREE(bits);
-	}
+int domain_to_cpus(int domain, unsigned long long int* mask)
+{
+	struct topology *t = get_topology();
 
-	return ret;
+	if (!t || domain < 0 || domain >= t->num_domains)
+		return -1;
+
+	return set_to_ull(TOPO_SET(t, domain_cpus, domain), t->setsize, mask);
 }
 
 int cpu_to_domains(int cpu, unsigned long long int* mask)
 {
-	/* TODO: Support more than 64 domains. Instead of using 'ull' for 'mask',
-	   consider using gcc's __uint128_t or some struct. */
-
-	cpu_set_t *bits;
-	size_t sz;
-	int ret;
+	struct topology *t = get_topology();
 
-	/* number of CPUs exceeds what we can pack in ull */
-	if (num_online_cpus() > sizeof(unsigned long long int)*8)
+	if (!t || cpu < 0 || cpu >= t->nbits)
 		return -1;
 
-	ret = read_mapping(cpu, "cpus", &bits, &sz);
-	if (!ret) {
-		*mask = cpusettoull(bits, sz);
-		CPU_FREE(bits);
-	}
-
-	return ret;
+	return set_to_ull(TOPO_SET(t, cpu_domains, cpu), t->setsize, mask);
 }
 
 int domain_to_first_cpu(int domain)
 {
-	cpu_set_t *bits;
-	size_t sz;
-	int i, n_online;
-	int first;
-
-	int ret = read_mapping(domain, "domains", &bits, &sz);
+	struct topology *t = get_topology();
 
-	if (ret)
-		return ret;
-
-	n_online = num_online_cpus();
-	first = -1; /* assume failure */
-	for (i = 0; i < n_online; ++i) {
-		if(CPU_ISSET_S(i, sz, bits)) {
-			first = i;
-			break;
-		}
-	}
-	CPU_FREE(bits);
+	if (!t || domain < 0 || domain >= t->num_domains)
+		return -1;
 
-	return first;
+	return t->first_cpu[domain];
 }
 
 int be_migrate_thread_to_cpu(pid_t tid, int target_cpu)
@@ -208,23 +368,17 @@ int be_migrate_thread_to_cpu(pid_t tid, int target_cpu)
 
 int be_migrate_thread_to_domain(pid_t tid, int domain)
 {
-	int	ret;
-	cpu_set_t *cpu_set;
-	size_t sz;
+	struct topology *t = get_topology();
 
-	ret = read_mapping(domain, "domains", &cpu_set, &sz);
-	if (ret != 0)
-		return ret;
+	if (!t || domain < 0 || domain >= t->num_domains)
+		return -1;
 
 	/* apply to caller */
 	if (tid == 0)
 		tid = gettid();
 
-	ret = sched_setaffinity(tid, sz, cpu_set);
-
-	CPU_FREE(cpu_set);
-
-	return ret;
+	return sched_setaffinity(tid, t->setsize,
+				 TOPO_SET(t, domain_cpus, domain));
 }
 
 int be_migrate_to_cpu(int target_cpu)
@@ -0,0 +1,75 @@
+#include <stdlib.h>
+
+#include "litmus.h"
+#include "internal.h"
+
+/* The job loop shared by all tools. */
+
+long litmus_run_periodic(litmus_job_fn job_fn, void *ctx,
+			 struct litmus_periodic_opts *opts)
+{
+	struct litmus_periodic_opts none = {0};
+	struct litmus_job_info job;
+	struct rt_task param;
+	lt_t end = 0, rel_deadline = 0, completion, wakeup;
+	long jobs = 0;
+	int more, approximate;
+
+	if (!opts)
+		opts = &none;
+	opts->overruns = 0;
+	opts->max_tardiness = 0;
+
+	wakeup = cycles_clock();
+	if (opts->duration)
+		end = wakeup + opts->duration;
+
+	/* fallback if the control page does not tell us the deadline */
+	if (get_rt_task_param(gettid(), &param) == 0)
+		rel_deadline = param.relative_deadline ?
+			param.relative_deadline : param.period;
+
+	do {
+		if (get_job_info(&job) != 0)
+			job.job_no = jobs + 1;
+		approximate = !job.release && rel_deadline;
+		if (approximate) {
+			job.release  = wakeup;
+			job.deadline = wakeup + rel_deadline;
+		}
+
+		if (opts->pre_job && !opts->pre_job(ctx, &job))
+			break;
+
+		litmus_trace(LITMUS_EV_JOB_START, job.job_no);
+		more = job_fn(ctx, &job);
+		litmus_trace(LITMUS_EV_JOB_END, job.job_no);
+
+		completion = cycles_clock();
+		jobs++;
+
+		if (job.deadline && completion > job.deadline) {
+			opts->overruns++;
+			if (completion - job.deadline > opts->max_tardiness)
+				opts->max_tardiness = completion - job.deadline;
+			if (opts->overrun)
+				opts->overrun(ctx, &job, completion);
+		}
+		if (opts->post_job)
+			opts->post_job(ctx, &job, completion);
+
+		/* complete the job, the last one included */
+		if (sleep_next_period() != 0)
+			return -1;
+
+		if (!more ||
+		    (opts->max_jobs && jobs >= opts->max_jobs) ||
+		    (end && completion >= end))
+			break;
+
+		if (approximate)
+			wakeup = cycles_clock();
+	} while (1);
+
+	return jobs;
+}
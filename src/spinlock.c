@@ -0,0 +1,78 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+#include "litmus.h"
+#include "fastpath.h"
+#include "internal.h"
+
+/* Non-preemptive ticket spinlocks in shared memory.
+ *
+ * Since all-zero memory is an unlocked lock, a lock file that was just
+ * created or grown needs no further initialization.
+ */
+
+void np_spinlock_init(struct np_spinlock *lock)
+{
+	memset(lock, 0, sizeof(*lock));
+}
+
+struct np_spinlock* np_spinlocks_map(const char *name_space, int count)
+{
+	struct stat st;
+	size_t size = count * sizeof(struct np_spinlock);
+	void *locks = MAP_FAILED;
+	int fd;
+
+	BUILD_BUG_ON(sizeof(struct np_spinlock) != NP_SPINLOCK_SIZE);
+
+	if (count <= 0)
+		return NULL;
+
+	fd = open(name_space, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+	if (fd < 0)
+		return NULL;
+
+	/* Grow the file under an exclusive lock so that concurrent users
+	 * cannot shrink it again (and discard held locks). */
+	if (flock(fd, LOCK_EX) == 0) {
+		if (fstat(fd, &st) == 0 &&
+		    ((size_t) st.st_size >= size || ftruncate(fd, size) == 0))
+			locks = mmap(NULL, size, PROT_READ | PROT_WRITE,
+				     MAP_SHARED, fd, 0);
+		flock(fd, LOCK_UN);
+	}
+	close(fd);
+
+	return locks == MAP_FAILED ? NULL : locks;
+}
+
+int np_spinlocks_unmap(struct np_spinlock *locks, int count)
+{
+	return munmap(locks, count * sizeof(struct np_spinlock));
+}
+
+void np_spin_lock(struct np_spinlock *lock)
+{
+	enter_np();
+	__np_spin_acquire(lock);
+}
+
+int np_spin_trylock(struct np_spinlock *lock)
+{
+	enter_np();
+	if (__np_spin_tryacquire(lock))
+		return 1;
+	exit_np();
+	return 0;
+}
+
+void np_spin_unlock(struct np_spinlock *lock)
+{
+	__np_spin_release(lock);
+	exit_np();
+}
@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "litmus.h"
+#include "fastpath.h"
+#include "internal.h"
+
+/* Per-thread job latency histograms.
+ *
+ * Histograms are log-linear: values below 2^HIST_SUB_BITS ns have a bucket
+ * each, larger values are split into 2^HIST_SUB_BITS buckets per power of
+ * two, i.e., they are recorded with a relative error of at most 1/16. Each
+ * thread only ever writes its own, cache-line aligned histograms; dumping
+ * reads them without synchronization, which is fine for counters that
+ * only grow. For the same reason, only the owner clears its histograms: a
+ * reset just bumps a generation number, and each thread clears its
+ * histograms before the next update once it sees a new generation. Until
+ * then, dumping skips them. Like trace rings, histograms are never freed.
+ */
+
+#define HIST_SUB_BITS 4
+#define HIST_SUB      (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS  ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+struct hist {
+	uint64_t count;
+	uint64_t max;
+	uint64_t bucket[HIST_BUCKETS];
+};
+
+enum {
+	HIST_RESPONSE,
+	HIST_TARDINESS,
+	HIST_WAKEUP,
+	NUM_HISTS
+};
+
+static const char *hist_name[NUM_HISTS] = {
+	"response time",
+	"tardiness",
+	"wake-up latency",
+};
+
+struct thread_stats {
+	struct hist hist[NUM_HISTS];
+	/* value of stats_generation the histograms belong to */
+	volatile unsigned int generation;
+	struct thread_stats *next;
+} __attribute__((aligned(64)));
+
+__thread struct thread_stats *__litmus_stats;
+
+static volatile unsigned int stats_generation;
+
+static struct thread_stats *all_stats;
+static pthread_mutex_t all_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline unsigned int hist_index(uint64_t val)
+{
+	int shift;
+
+	if (val < HIST_SUB)
+		return val;
+	shift = 63 - __builtin_clzll(val) - HIST_SUB_BITS;
+	return (shift + 1) * HIST_SUB + ((val >> shift) & (HIST_SUB - 1));
+}
+
+/* largest value that maps to the given bucket */
+static uint64_t hist_value(unsigned int idx)
+{
+	int shift;
+
+	if (idx < HIST_SUB)
+		return idx;
+	shift = idx / HIST_SUB - 1;
+	return ((uint64_t) (HIST_SUB + idx % HIST_SUB) << shift)
+		+ ((1ULL << shift) - 1);
+}
+
+/* called by the owner before updating its histograms */
+static inline void stats_sync_generation(struct thread_stats *stats)
+{
+	unsigned int gen = stats_generation;
+
+	if (__builtin_expect(stats->generation != gen, 0)) {
+		memset(stats->hist, 0, sizeof(stats->hist));
+		/* dumps may use the histograms only once they are clear */
+		__sync_synchronize();
+		stats->generation = gen;
+	}
+}
+
+static inline void hist_add(struct hist *h, uint64_t val)
+{
+	h->bucket[hist_index(val)]++;
+	h->count++;
+	if (val > h->max)
+		h->max = val;
+}
+
+int litmus_stats_thread_init(void)
+{
+	void *mem;
+
+	if (__litmus_stats)
+		return 0;
+
+	if (posix_memalign(&mem, 64, sizeof(struct thread_stats)))
+		return -1;
+	memset(mem, 0, sizeof(struct thread_stats));
+	((struct thread_stats*) mem)->generation = stats_generation;
+
+	pthread_mutex_lock(&all_stats_lock);
+	((struct thread_stats*) mem)->next = all_stats;
+	all_stats = mem;
+	pthread_mutex_unlock(&all_stats_lock);
+
+	__litmus_stats = mem;
+	return 0;
+}
+
+void litmus_stats_record_job(lt_t release, lt_t deadline, lt_t completion)
+{
+	struct thread_stats *stats = __litmus_stats;
+
+	if (!stats)
+		return;
+
+	stats_sync_generation(stats);
+	hist_add(&stats->hist[HIST_RESPONSE],
+		 completion > release ? completion - release : 0);
+	hist_add(&stats->hist[HIST_TARDINESS],
+		 completion > deadline ? completion - deadline : 0);
+}
+
+/* sleep_next_period() of threads that keep statistics */
+int stats_sleep_next_period(void)
+{
+	struct thread_stats *stats = __litmus_stats;
+	struct litmus_job_info job;
+	lt_t now;
+	int ret;
+
+	/* release and deadline are only known with control page support */
+	if (get_job_info(&job) == 0 && job.release)
+		litmus_stats_record_job(job.release, job.deadline,
+					cycles_clock());
+
+	ret = sleep_next_period_fast();
+
+	if (ret == 0 && get_job_info(&job) == 0 && job.release) {
+		now = cycles_clock();
+		stats_sync_generation(stats);
+		hist_add(&stats->hist[HIST_WAKEUP],
+			 now > job.release ? now - job.release : 0);
+	}
+	return ret;
+}
+
+void litmus_stats_reset(void)
+{
+	/* the owners update their histograms concurrently, let them clear
+	 * them, too */
+	__sync_fetch_and_add(&stats_generation, 1);
+}
+
+/* value at or below which the given fraction of all samples lie */
+static uint64_t hist_percentile(const struct hist *h, double fraction)
+{
+	uint64_t rank = (uint64_t) (h->count * fraction), seen = 0;
+	unsigned int i;
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen += h->bucket[i];
+		if (seen > rank)
+			break;
+	}
+	if (i == HIST_BUCKETS)
+		return h->max;
+	/* the bucket's upper end is never above the true maximum */
+	return hist_value(i) < h->max ? hist_value(i) : h->max;
+}
+
+void litmus_stats_dump(FILE *out)
+{
+	struct hist *merged;
+	struct thread_stats *stats;
+	int h, i;
+
+	merged = calloc(NUM_HISTS, sizeof(*merged));
+	if (!merged)
+		return;
+
+	pthread_mutex_lock(&all_stats_lock);
+	for (stats = all_stats; stats; stats = stats->next) {
+		/* not cleared since the last reset yet, i.e., empty */
+		if (stats->generation != stats_generation)
+			continue;
+		for (h = 0; h < NUM_HISTS; h++) {
+			merged[h].count += stats->hist[h].count;
+			if (stats->hist[h].max > merged[h].max)
+				merged[h].max = stats->hist[h].max;
+			for (i = 0; i < HIST_BUCKETS; i++)
+				merged[h].bucket[i] += stats->hist[h].bucket[i];
+		}
+	}
+	pthread_mutex_unlock(&all_stats_lock);
+
+	fprintf(out, "%-16s %10s %12s %12s %12s %12s\n",
+		"[us]", "jobs", "p50", "p99", "p99.9", "max");
+	for (h = 0; h < NUM_HISTS; h++)
+		fprintf(out, "%-16s %10llu %12.2f %12.2f %12.2f %12.2f\n",
+			hist_name[h],
+			(unsigned long long) merged[h].count,
+			hist_percentile(&merged[h], 0.5) / 1E3,
+			hist_percentile(&merged[h], 0.99) / 1E3,
+			hist_percentile(&merged[h], 0.999) / 1E3,
+			merged[h].max / 1E3);
+	free(merged);
+}
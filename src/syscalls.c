@@ -9,6 +9,8 @@
 #include <unistd.h>
 
 #include "litmus.h"
+#include "fastpath.h"
+#include "internal.h"
 
 /*	Syscall stub for setting RT mode and scheduling options */
 
@@ -29,7 +31,9 @@ int get_rt_task_param(pid_t pid, struct rt_task *param)
 
 int sleep_next_period(void)
 {
-	return syscall(__NR_complete_job);
+	if (unlikely(__litmus_stats != NULL))
+		return stats_sleep_next_period();
+	return sleep_next_period_fast();
 }
 
 int od_openx(int fd, obj_type_t type, int obj_id, void *config)
@@ -44,23 +48,16 @@ int od_close(int od)
 
 int litmus_lock(int od)
 {
-	return syscall(__NR_litmus_lock, od);
+	return litmus_lock_fast(od);
 }
 
 int litmus_unlock(int od)
 {
-	return syscall(__NR_litmus_unlock, od);
+	return litmus_unlock_fast(od);
 }
 
-int get_job_no(unsigned int *job_no)
-{
-	return syscall(__NR_query_job_no, job_no);
-}
-
-int wait_for_job_release(unsigned int job_no)
-{
-	return syscall(__NR_wait_for_job_release, job_no);
-}
+/* get_job_no() and wait_for_job_release() live in kernel_iface.c since they
+ * can be answered from the control page. */
 
 int sched_setscheduler(pid_t pid, int policy, int* priority)
 {
@@ -84,7 +81,7 @@ int release_ts(lt_t *delay)
 
 int null_call(cycles_t *timestamp)
 {
-	return syscall(__NR_null_call, timestamp);
+	return null_call_fast(timestamp);
 }
 
 int reservation_create(int rtype, void *config)
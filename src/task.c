@@ -14,7 +14,7 @@ int task_mode(int mode)
 {
 	struct sched_param param;
 	int me     = gettid();
-	int policy = sched_getscheduler(gettid());
+	int policy = sched_getscheduler(me);
 	int old_mode = policy == SCHED_LITMUS ? LITMUS_RT_TASK : BACKGROUND_TASK;
 
 	param.sched_priority = 0;
@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "litmus.h"
+#include "internal.h"
+
+/* Per-thread event trace rings.
+ *
+ * Each traced thread owns a single-producer/single-consumer ring: only the
+ * thread itself advances head, only the drain thread advances tail. When the
+ * ring is full, events are counted as dropped rather than blocking the
+ * traced thread; the count is written into the ring as a LITMUS_EV_DROPPED
+ * record in front of the next event that fits, so that the gap stays at its
+ * place in the stream. Rings are linked into a global list when they are created
+ * and never freed, so the drain thread can keep reading the rings of
+ * threads that have already exited.
+ */
+
+#define TRACE_RING_SIZE 4096 /* records, must be a power of two */
+#define TRACE_DRAIN_PERIOD ms2ns(10)
+
+struct trace_ring {
+	struct litmus_trace_rec rec[TRACE_RING_SIZE];
+	volatile unsigned int head;
+	volatile unsigned int tail;
+	unsigned int dropped;	/* not yet in the ring, owned by the producer */
+	uint32_t tid;
+	struct trace_ring *next;
+};
+
+int __litmus_trace_enabled = 0;
+
+static __thread struct trace_ring *my_ring;
+
+static struct trace_ring *rings;
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int trace_fd = -1;
+static pthread_t drain_thread;
+static volatile int draining;
+static unsigned long total_dropped;
+
+void __litmus_trace_record(int event, uint32_t arg)
+{
+	struct trace_ring *ring = my_ring;
+	struct litmus_trace_rec *rec;
+	unsigned int head;
+
+	if (!ring)
+		return;
+
+	head = ring->head;
+	/* pending drops need a slot of their own */
+	if (head - ring->tail > TRACE_RING_SIZE - 1 - !!ring->dropped) {
+		ring->dropped++;
+		return;
+	}
+	if (ring->dropped) {
+		rec = &ring->rec[head & (TRACE_RING_SIZE - 1)];
+		rec->timestamp = get_cycles();
+		rec->arg = ring->dropped;
+		rec->event = LITMUS_EV_DROPPED;
+		ring->dropped = 0;
+		head++;
+	}
+	rec = &ring->rec[head & (TRACE_RING_SIZE - 1)];
+	rec->timestamp = get_cycles();
+	rec->arg = arg;
+	rec->event = event;
+	/* publish the record only after it was written */
+	__sync_synchronize();
+	ring->head = head + 1;
+}
+
+int litmus_trace_thread_init(void)
+{
+	struct trace_ring *ring;
+
+	if (my_ring)
+		return 0;
+
+	ring = calloc(1, sizeof(*ring));
+	if (!ring)
+		return -1;
+	ring->tid = gettid();
+
+	pthread_mutex_lock(&rings_lock);
+	ring->next = rings;
+	rings = ring;
+	pthread_mutex_unlock(&rings_lock);
+
+	my_ring = ring;
+	return 0;
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+	const char *pos = buf;
+	ssize_t ret;
+
+	while (len) {
+		ret = write(fd, pos, len);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return -1;
+		pos += ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+/* Write the pending records of one ring as (at most two) chunks. Drops that
+ * are not followed by another event yet are reported only once tracing has
+ * stopped (final), in the header of the last chunk. */
+static void drain_ring(struct trace_ring *ring, int final)
+{
+	struct litmus_trace_chunk chunk;
+	unsigned int head, tail, start, count, dropped = 0, i;
+
+	head = ring->head;
+	/* read the records only after seeing head */
+	__sync_synchronize();
+	tail = ring->tail;
+
+	chunk.magic = LITMUS_TRACE_MAGIC;
+	chunk.tid = ring->tid;
+	if (final) {
+		/* the producer does not record anymore */
+		dropped = ring->dropped;
+		ring->dropped = 0;
+		total_dropped += dropped;
+	}
+
+	do {
+		/* don't wrap around within a chunk */
+		start = tail & (TRACE_RING_SIZE - 1);
+		count = head - tail;
+		if (start + count > TRACE_RING_SIZE)
+			count = TRACE_RING_SIZE - start;
+
+		for (i = start; i < start + count; i++)
+			if (ring->rec[i].event == LITMUS_EV_DROPPED)
+				total_dropped += ring->rec[i].arg;
+
+		chunk.count = count;
+		/* events were lost after the newest record in the ring */
+		chunk.dropped = tail + count == head ? dropped : 0;
+		if ((count || chunk.dropped) &&
+		    (write_all(trace_fd, &chunk, sizeof(chunk)) ||
+		     write_all(trace_fd, &ring->rec[start],
+			       count * sizeof(struct litmus_trace_rec))))
+			perror("litmus_trace: write");
+
+		tail += count;
+	} while (tail != head);
+
+	/* hand the slots back to the producer */
+	__sync_synchronize();
+	ring->tail = tail;
+}
+
+static void drain_all(int final)
+{
+	struct trace_ring *ring;
+
+	pthread_mutex_lock(&rings_lock);
+	for (ring = rings; ring; ring = ring->next)
+		drain_ring(ring, final);
+	pthread_mutex_unlock(&rings_lock);
+}
+
+static void* drain_main(void *unused)
+{
+	while (draining) {
+		lt_sleep(TRACE_DRAIN_PERIOD);
+		drain_all(0);
+	}
+	return NULL;
+}
+
+int litmus_trace_start(const char *file)
+{
+	struct trace_ring *ring;
+
+	if (trace_fd >= 0) {
+		errno = EBUSY;
+		return -1;
+	}
+
+	trace_fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (trace_fd < 0)
+		return -1;
+
+	/* forget events recorded after a previous litmus_trace_stop() */
+	pthread_mutex_lock(&rings_lock);
+	for (ring = rings; ring; ring = ring->next) {
+		ring->tail = ring->head;
+		ring->dropped = 0;
+	}
+	pthread_mutex_unlock(&rings_lock);
+
+	total_dropped = 0;
+	draining = 1;
+	if (pthread_create(&drain_thread, NULL, drain_main, NULL)) {
+		close(trace_fd);
+		trace_fd = -1;
+		return -1;
+	}
+
+	__sync_synchronize();
+	__litmus_trace_enabled = 1;
+	return 0;
+}
+
+unsigned long litmus_trace_stop(void)
+{
+	if (trace_fd < 0)
+		return 0;
+
+	__litmus_trace_enabled = 0;
+	__sync_synchronize();
+
+	draining = 0;
+	pthread_join(drain_thread, NULL);
+	/* pick up whatever arrived since the last pass */
+	drain_all(1);
+
+	close(trace_fd);
+	trace_fd = -1;
+	return total_dropped;
+}
@@ -7,6 +7,9 @@
 #include "tests.h"
 #include "litmus.h"
 
+#define LITMUS_NP_STATS
+#include "fastpath.h"
+
 
 TESTCASE(set_rt_task_param_invalid_pointer, ALL,
 	 "reject invalid rt_task pointers")
@@ -151,6 +154,58 @@ TESTCASE(rt_fork_non_rt, LITMUS,
 	}
 }
 
+TESTCASE(job_info_ctrl_page, LITMUS,
+	 "job info from the control page tracks job releases")
+{
+	struct litmus_job_info info;
+	unsigned int job_no, next;
+
+	SYSCALL( sporadic_partitioned(ms2ns(10), ms2ns(100), 0) );
+	SYSCALL( task_mode(LITMUS_RT_TASK) );
+
+	SYSCALL( sleep_next_period() );
+	SYSCALL( get_job_no(&job_no) );
+	SYSCALL( get_job_info(&info) );
+	ASSERT( info.job_no == job_no );
+	ASSERT( info.deadline >= info.release );
+
+	/* already released, must not block */
+	SYSCALL( wait_for_job_release(job_no) );
+
+	next = job_no + 1;
+	SYSCALL( wait_for_job_release(next) );
+	SYSCALL( get_job_no(&job_no) );
+	ASSERT( job_no == next );
+
+	SYSCALL( task_mode(BACKGROUND_TASK) );
+}
+
+TESTCASE(topology_consistent, ALL,
+	 "cached domain and CPU sets are consistent")
+{
+	int d, cpu, n = num_domains();
+	size_t sz = CPU_ALLOC_SIZE(num_online_cpus() + n);
+	cpu_set_t *cpus = CPU_ALLOC(num_online_cpus() + n);
+	cpu_set_t *domains = CPU_ALLOC(num_online_cpus() + n);
+
+	ASSERT( n >= 0 );
+	for (d = 0; d < n; d++) {
+		SYSCALL( domain_to_cpuset(d, sz, cpus) );
+		cpu = domain_to_first_cpu(d);
+		ASSERT( cpu >= 0 );
+		ASSERT( CPU_ISSET_S(cpu, sz, cpus) );
+		SYSCALL( cpu_to_domainset(cpu, sz, domains) );
+		ASSERT( CPU_ISSET_S(d, sz, domains) );
+	}
+	SYSCALL_FAILS( EINVAL, domain_to_cpuset(n, sz, cpus) );
+
+	SYSCALL( litmus_refresh_topology() );
+	ASSERT( num_domains() == n );
+
+	CPU_FREE(cpus);
+	CPU_FREE(domains);
+}
+
 TESTCASE(ctrl_page_writable, ALL,
 	 "tasks have write access to /dev/litmus/ctrl mappings")
 {
@@ -168,6 +223,37 @@ TESTCASE(ctrl_page_writable, ALL,
 	ctrl_page[32] = 0x12345678;
 }
 
+TESTCASE(np_fast_nesting, ALL,
+	 "inline NP sections nest and are counted once")
+{
+	struct control_page *cp = get_ctrl_page();
+	struct np_stats stats;
+
+	ASSERT(cp != NULL);
+	reset_np_stats();
+
+	enter_np_fast();
+	enter_np_fast();
+	ASSERT( cp->sched.np.flag == 2 );
+	exit_np_fast();
+	ASSERT( cp->sched.np.flag == 1 );
+	exit_np_fast();
+	ASSERT( cp->sched.np.flag == 0 );
+
+	/* unbalanced exits are ignored */
+	exit_np_fast();
+	ASSERT( cp->sched.np.flag == 0 );
+
+	{
+		NP_SCOPE();
+		ASSERT( cp->sched.np.flag == 1 );
+	}
+	ASSERT( cp->sched.np.flag == 0 );
+
+	get_np_stats(&stats);
+	ASSERT( stats.sections == 2 );
+	ASSERT( stats.preempted <= stats.sections );
+}
 
 TESTCASE(suspended_admission, LITMUS,
 	 "admission control handles suspended tasks correctly")
@@ -226,6 +312,47 @@ TESTCASE(suspended_admission, LITMUS,
 	ASSERT( status == 0 );
 }
 
+TESTCASE(batch_admission, LITMUS,
+	 "batch admission sets up suspended tasks")
+{
+	struct litmus_admit_spec specs[2];
+	int pipefd[2], err, token = 0, status, i;
+
+	SYSCALL( pipe(pipefd) );
+
+	for (i = 0; i < 2; i++) {
+		specs[i].tid = FORK_TASK(
+			/* suspend until admitted */
+			err = read(pipefd[0], &token, sizeof(token));
+			ASSERT(err == sizeof(token));
+
+			ASSERT( sched_getscheduler(gettid()) == SCHED_LITMUS );
+			SYSCALL( init_rt_thread() );
+			SYSCALL( sleep_next_period() );
+			exit(0);
+			);
+		init_rt_task_param(&specs[i].param);
+		specs[i].param.exec_cost = ms2ns(10);
+		specs[i].param.period    = ms2ns(100);
+		specs[i].domain = 0;
+	}
+
+	/* give children some time to suspend */
+	SYSCALL( lt_sleep(ms2ns(100)) );
+
+	ASSERT( litmus_admit_batch(specs, 2, LITMUS_ADMIT_RT_MODE) == 2 );
+	ASSERT( specs[0].status == 0 && specs[1].status == 0 );
+
+	token = 1234;
+	for (i = 0; i < 2; i++)
+		ASSERT( write(pipefd[1], &token, sizeof(token)) == sizeof(token) );
+
+	for (i = 0; i < 2; i++) {
+		SYSCALL( waitpid(specs[i].tid, &status, 0) );
+		ASSERT( status == 0 );
+	}
+}
+
 TESTCASE(running_admission, LITMUS,
 	 "admission control handles running tasks correctly")
 {
@@ -100,3 +100,38 @@ TESTCASE(not_inherit_od, GSN_EDF | PSN_EDF,
 }
 
 
+
+TESTCASE(open_locks_batch, GSN_EDF | PSN_EDF | P_FP,
+	 "open and close locks in bulk through a namespace handle")
+{
+	int ns, i, od;
+	struct litmus_lock_spec specs[3];
+
+	SYSCALL( ns = litmus_open_namespace(".fmlp_locks") );
+
+	for (i = 0; i < 3; i++) {
+		specs[i].protocol = FMLP_SEM;
+		specs[i].lock_id = i;
+		specs[i].config_param = NULL;
+	}
+	SYSCALL( litmus_open_locks(ns, specs, 3) );
+	for (i = 0; i < 3; i++)
+		ASSERT( specs[i].od >= 0 );
+	SYSCALL( litmus_close_locks(specs, 3) );
+	for (i = 0; i < 3; i++)
+		ASSERT( specs[i].od == -1 );
+
+	/* a failure closes the locks opened before it */
+	specs[2].protocol = -1;
+	SYSCALL_FAILS( EINVAL, litmus_open_locks(ns, specs, 3) );
+	ASSERT( specs[0].od == -1 );
+	ASSERT( specs[1].od == -1 );
+
+	/* the handle outlives the locks */
+	SYSCALL( od = litmus_open_lock_ns(ns, FMLP_SEM, 0, NULL) );
+	SYSCALL( od_close(od) );
+
+	SYSCALL( litmus_close_namespace(ns) );
+
+	SYSCALL( remove(".fmlp_locks") );
+}
@@ -2,6 +2,7 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <sys/wait.h> /* for waitpid() */
+#include <sys/mman.h>
 
 #include "tests.h"
 #include "litmus.h"
@@ -392,3 +393,47 @@ TESTCASE(dflp_lock_teardown, P_FP,
 	SYSCALL( remove(".locks") );
 }
 
+
+TESTCASE(np_spinlock_exclusion, ALL,
+	 "non-preemptive spinlocks in shared memory provide mutual exclusion")
+{
+	struct np_spinlock *locks;
+	volatile int *counter;
+	int i, child, status;
+
+	/* don't inherit a lock held by an aborted earlier run */
+	remove(".np_spinlocks");
+	ASSERT( (locks = np_spinlocks_map(".np_spinlocks", 2)) != NULL );
+	counter = mmap(NULL, sizeof(*counter), PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	ASSERT( counter != MAP_FAILED );
+	*counter = 0;
+
+	/* fresh locks are unlocked */
+	ASSERT( np_spin_trylock(&locks[1]) );
+	ASSERT( !np_spin_trylock(&locks[1]) );
+	np_spin_unlock(&locks[1]);
+
+	child = FORK_TASK(
+		for (i = 0; i < 100000; i++) {
+			np_spin_lock(&locks[0]);
+			*counter = *counter + 1;
+			np_spin_unlock(&locks[0]);
+		}
+		);
+
+	for (i = 0; i < 100000; i++) {
+		np_spin_lock(&locks[0]);
+		*counter = *counter + 1;
+		np_spin_unlock(&locks[0]);
+	}
+
+	SYSCALL( waitpid(child, &status, 0) );
+	ASSERT( WIFEXITED(status) );
+	ASSERT( WEXITSTATUS(status) == 0 );
+	ASSERT( *counter == 200000 );
+	ASSERT( get_ctrl_page()->sched.np.flag == 0 );
+
+	SYSCALL( np_spinlocks_unmap(locks, 2) );
+	SYSCALL( remove(".np_spinlocks") );
+}